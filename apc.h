@@ -110,6 +110,9 @@ PHP_APCU_API HashTable* apc_flip_hash(HashTable *hash);
 # define APC_HOTSPOT
 #endif
 
+/* assumed size of a cache line, used to keep frequently written shared data apart */
+#define APC_CACHE_LINE_SIZE 64
+
 /*
 * Serializer API
 */
@@ -39,6 +39,24 @@
 #include "ext/standard/php_var.h"
 #include "zend_smart_str.h"
 
+#ifdef PHP_WIN32
+# include "win32/time.h"
+#else
+# include <sys/time.h>
+# include <signal.h>
+#endif
+#include <errno.h>
+#include <math.h>
+
+#if defined(__SSE2__) && APC_CACHE_BUCKET_TAGS == 4
+# include <emmintrin.h>
+# define APC_CACHE_BUCKET_SIMD 1
+#endif
+
+/* the members of an entry lookups read, and the header of its key, fit the cache line the entry starts */
+typedef char apc_cache_entry_hot_size[
+	(XtOffsetOf(apc_cache_entry_t, key) + _ZSTR_HEADER_SIZE <= APC_CACHE_LINE_SIZE) ? 1 : -1];
+
 #if PHP_VERSION_ID < 70300
 # define GC_SET_REFCOUNT(ref, rc) (GC_REFCOUNT(ref) = (rc))
 # define GC_ADDREF(ref) GC_REFCOUNT(ref)++
@@ -47,13 +65,39 @@
 #define APC_POOL_ALLOC(size) apc_pool_alloc(ctxt->pool, ctxt->sma, (size))
 #define APC_POOL_STRING_DUP(str) apc_pool_string_dup(ctxt->pool, ctxt->sma, (str))
 
-/* If recursive mutexes are used, there is no distinction between read and write locks.
- * As such, if we acquire a read-lock, it's really a write-lock and we are free to perform
- * increments without atomics. */
-#ifdef APC_LOCK_RECURSIVE
-# define ATOMIC_INC_RLOCKED(a) (a)++
+/* Seconds after which the refresh of a stale entry is handed out again */
+#define APC_CACHE_REFRESH_TIMEOUT 10
+
+/* Milliseconds apc_cache_entry sleeps at most between two polls of a value being generated */
+#define APC_CACHE_FLIGHT_POLL 16
+
+/* Number of slots of cleared tables reclaimed at the end of a request */
+#define APC_CACHE_RECLAIM_STEP 256
+
+/* A shard grows its table once it holds more than this many entries per slot, a bucket
+   indexes as many entries as it has tags */
+#define APC_CACHE_MAX_LOAD APC_CACHE_BUCKET_TAGS
+
+/* A table only grows while 1/APC_CACHE_GROW_FREE of memory stays free once it is allocated */
+#define APC_CACHE_GROW_FREE 16
+
+/* Number of slots migrated to a grown table by each write */
+#define APC_CACHE_REHASH_STEP 16
+
+/* Rows of the frequency sketch, and occurences recorded per counter before it is aged */
+#define APC_CACHE_SKETCH_DEPTH 4
+#define APC_CACHE_SKETCH_SAMPLE 8
+
+/* New keys face admission once less than 1/APC_CACHE_ADMISSION_FREE of memory is free,
+ and are compared with the entries of this many slots */
+#define APC_CACHE_ADMISSION_FREE 16
+#define APC_CACHE_ADMISSION_SAMPLE 8
+
+/* Tag of a hash in a bucket, taken from the bits that did not select the slot */
+#if SIZEOF_ZEND_LONG == 8
+# define APC_CACHE_TAG(h) ((uint32_t) ((h) >> 32))
 #else
-# define ATOMIC_INC_RLOCKED(a) ATOMIC_INC(a)
+# define APC_CACHE_TAG(h) ((uint32_t) (h))
 #endif
 
 static APC_HOTSPOT zval* my_copy_zval(zval* dst, const zval* src, apc_context_t* ctxt);
@@ -96,116 +140,904 @@ static int const primes[] = {
 0      /* sentinel */
 };
 
-static int make_prime(int n)
-{
-	int *k = (int*)primes;
-	while(*k) {
-		if((*k) > n) return *k;
-		k++;
+static int make_prime(int n)
+{
+	int *k = (int*)primes;
+	while(*k) {
+		if((*k) > n) return *k;
+		k++;
+	}
+	return *(k-1);
+}
+/* }}} */
+
+/* {{{ make_pow2 */
+#define APC_CACHE_MAX_POW2 (1 << 20)
+
+static zend_long make_pow2(zend_long n)
+{
+	zend_long size = 256;
+
+	while (size <= n && size < APC_CACHE_MAX_POW2) {
+		size <<= 1;
+	}
+	return size;
+}
+/* }}} */
+
+/* {{{ make_table_size
+ Returns a table size larger than n, suitable for the slot mode of the cache */
+static zend_long make_table_size(zend_bool pow2_slots, zend_long n)
+{
+	return pow2_slots ? make_pow2(n) : make_prime(n);
+}
+/* }}} */
+
+static void free_entry(apc_cache_t *cache, apc_cache_entry_t *entry)
+{
+	apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
+
+	/* entries of missing keys have no pool */
+	if (cold->pool) {
+		apc_pool_destroy(cold->pool, cache->sma);
+	} else {
+		cache->sma->sfree(((char *) cold) - cold->offset);
+	}
+}
+
+/* {{{ apc_cache_key_shard
+ Returns the shard responsible for key */
+static inline apc_cache_shard_t *apc_cache_key_shard(apc_cache_t* cache, zend_string *key) {
+	if (cache->nshards == 1) {
+		return APC_CACHE_SHARD(cache, 0);
+	}
+
+	return APC_CACHE_SHARD(cache, ZSTR_HASH(key) % cache->nshards);
+} /* }}} */
+
+/* {{{ apc_cache_worker_counters
+ Returns the counter shard of the current worker */
+static inline apc_cache_counters_t *apc_cache_worker_counters(apc_cache_t* cache) {
+	return &cache->counters[APCG(counter_slot) % APC_CACHE_COUNTERS];
+} /* }}} */
+
+/* {{{ apc_cache_owner
+ Returns the context of the caller, as recorded by slam defense, flights and read sections */
+static inline apc_cache_owner_t apc_cache_owner(void) {
+#ifdef ZTS
+	return TSRMLS_CACHE;
+#else
+	return getpid();
+#endif
+} /* }}} */
+
+#ifdef ZTS
+# define APC_CACHE_OWNER_CAS(a, o, n) ATOMIC_CASPTR(a, o, n)
+# define APC_CACHE_OWNER_HASH(o) ((zend_ulong) (zend_uintptr_t) (o) / sizeof(void *))
+#else
+# define APC_CACHE_OWNER_CAS(a, o, n) ATOMIC_CAS32(a, o, n)
+# define APC_CACHE_OWNER_HASH(o) ((zend_ulong) (o))
+#endif
+
+/* {{{ apc_cache_owner_alive
+ Tells whether the context which claimed a read section may still leave it */
+static zend_bool apc_cache_owner_alive(apc_cache_owner_t owner) {
+#if !defined(ZTS) && !defined(PHP_WIN32)
+	return kill(owner, 0) == 0 || errno != ESRCH;
+#else
+	/* threads die with their process, and processes are not looked up on windows */
+	return 1;
+#endif
+} /* }}} */
+
+/* {{{ apc_cache_free_readers
+ Frees the read sections of owner, or when owner is 0, those of contexts which died */
+static void apc_cache_free_readers(apc_cache_t *cache, apc_cache_owner_t owner) {
+	zend_long i;
+
+	for (i = 0; i < cache->nreaders; i++) {
+		apc_cache_owner_t current = cache->readers[i].owner;
+
+		if (current && (owner ? current == owner : !apc_cache_owner_alive(current))) {
+			APC_CACHE_OWNER_CAS(cache->readers[i].owner, current, 0);
+		}
+	}
+} /* }}} */
+
+/* {{{ apc_cache_epoch_enter
+ Enters a read section, entries and tables reached before the section is left are not
+ freed, even once removed. Returns the section to pass to apc_cache_epoch_leave, or NULL
+ when every slot is taken, see apc_cache_read_enter */
+static apc_cache_reader_t *apc_cache_epoch_enter(apc_cache_t *cache) {
+	apc_cache_owner_t owner = apc_cache_owner();
+	zend_ulong start = APC_CACHE_OWNER_HASH(owner), i, n = (zend_ulong) cache->nreaders;
+	apc_cache_reader_t *reader;
+	zend_ulong epoch;
+
+#ifndef ZTS
+	/* sections recorded for our pid belong to a process which died before the pid was reused */
+	if (cache->reader_owner != owner) {
+		apc_cache_free_readers(cache, owner);
+		cache->reader_owner = owner;
+	}
+#endif
+
+	for (i = 0; i < 2 * n; i++) {
+		reader = &cache->readers[(start + i) % n];
+
+		if (!reader->owner && APC_CACHE_OWNER_CAS(reader->owner, 0, owner)) {
+			break;
+		}
+
+		/* every slot is taken, free those of workers which died and look once more */
+		if (i + 1 == n) {
+			apc_cache_free_readers(cache, 0);
+		}
+	}
+
+	if (i == 2 * n) {
+		return NULL;
+	}
+
+	do {
+		epoch = cache->header->epoch;
+		reader->epoch = epoch;
+		APC_MEMORY_BARRIER();
+
+		/* the gc may have advanced the epoch before it could see us */
+	} while (cache->header->epoch != epoch);
+
+	return reader;
+} /* }}} */
+
+/* {{{ apc_cache_epoch_leave */
+static inline void apc_cache_epoch_leave(apc_cache_t *cache, apc_cache_reader_t *reader) {
+	APC_MEMORY_BARRIER();
+	reader->owner = 0;
+} /* }}} */
+
+/* {{{ apc_cache_read_enter
+ Keeps the entries of key found until apc_cache_read_leave from being freed. Enters a read
+ section, or when every section is taken, read locks the shard of key and sets locked */
+static apc_cache_reader_t *apc_cache_read_enter(
+		apc_cache_t *cache, zend_string *key, apc_cache_shard_t **locked) {
+	apc_cache_reader_t *reader = apc_cache_epoch_enter(cache);
+
+	*locked = NULL;
+	if (!reader) {
+		*locked = apc_cache_key_shard(cache, key);
+		APC_RLOCK(*locked);
+	}
+
+	return reader;
+} /* }}} */
+
+/* {{{ apc_cache_read_leave */
+static inline void apc_cache_read_leave(
+		apc_cache_t *cache, apc_cache_reader_t *reader, apc_cache_shard_t *locked) {
+	if (reader) {
+		apc_cache_epoch_leave(cache, reader);
+	} else {
+		APC_RUNLOCK(locked);
+	}
+} /* }}} */
+
+/* {{{ apc_cache_epoch_advance
+ Advances the epoch once no section is left open in the epoch before the current one,
+ the caller must hold the header lock. The sections of workers which died in them are
+ freed, sections held open for longer than gc_ttl are reported, but still waited for */
+static zend_bool apc_cache_epoch_advance(apc_cache_t *cache, time_t now) {
+	zend_ulong epoch = cache->header->epoch;
+	zend_long i, held = 0;
+
+	APC_MEMORY_BARRIER();
+
+	for (i = 0; i < cache->nreaders; i++) {
+		apc_cache_reader_t *reader = &cache->readers[i];
+		apc_cache_owner_t owner = reader->owner;
+
+		if (!owner || reader->epoch >= epoch) {
+			continue;
+		}
+
+		/* only look for dead workers once the epoch was held back for a while */
+		if (cache->header->epoch_held && now > cache->header->epoch_held
+				&& !apc_cache_owner_alive(owner)) {
+			APC_CACHE_OWNER_CAS(reader->owner, owner, 0);
+			continue;
+		}
+
+		held++;
+	}
+
+	if (held) {
+		if (!cache->header->epoch_held) {
+			cache->header->epoch_held = now;
+		}
+
+		/* good ol' whining */
+		if (cache->gc_ttl && now - cache->header->epoch_held > (time_t)cache->gc_ttl) {
+			apc_debug(
+				"GC epoch %lu was held back by %ld workers for %ld seconds",
+				(unsigned long) epoch, held, (long) (now - cache->header->epoch_held)
+			);
+		}
+
+		return 0;
+	}
+
+	cache->header->epoch = epoch + 1;
+	cache->header->epoch_held = 0;
+
+	return 1;
+} /* }}} */
+
+/* {{{ apc_cache_hash_shard
+ Note: These calculations can and should be done outside of a lock */
+static void apc_cache_hash_shard(
+		apc_cache_t* cache, zend_string *key, zend_ulong* hash, apc_cache_shard_t **shard) {
+	*hash = ZSTR_HASH(key);
+
+	if (cache->nshards == 1) {
+		*shard = APC_CACHE_SHARD(cache, 0);
+	} else {
+		*shard = APC_CACHE_SHARD(cache, *hash % cache->nshards);
+	}
+} /* }}} */
+
+/* {{{ apc_cache_hash_mix
+ Finalizer spreading every bit of the hash over the low bits, which
+ alone select the slot in power of two tables (murmur3 fmix) */
+static inline zend_ulong apc_cache_hash_mix(zend_ulong hash) {
+#if SIZEOF_ZEND_LONG == 8
+	hash ^= hash >> 33;
+	hash *= Z_UL(0xff51afd7ed558ccd);
+	hash ^= hash >> 33;
+	hash *= Z_UL(0xc4ceb9fe1a85ec53);
+	hash ^= hash >> 33;
+#else
+	hash ^= hash >> 16;
+	hash *= Z_UL(0x85ebca6b);
+	hash ^= hash >> 13;
+	hash *= Z_UL(0xc2b2ae35);
+	hash ^= hash >> 16;
+#endif
+	return hash;
+} /* }}} */
+
+/* {{{ apc_cache_table_slot
+ Returns the slot for hash in table, the low part of the hash already selected the shard */
+static inline zend_ulong apc_cache_table_slot(
+		apc_cache_t* cache, apc_cache_table_t *table, zend_ulong hash) {
+	if (table->mask) {
+		return apc_cache_hash_mix(hash) & table->mask;
+	}
+
+	if (cache->nshards == 1) {
+		return hash % table->nslots;
+	}
+
+	return (hash / cache->nshards) % table->nslots;
+} /* }}} */
+
+/* {{{ apc_cache_wlock_all
+ Whole cache operations lock every shard, always in ascending order */
+static zend_bool apc_cache_wlock_all(apc_cache_t* cache) {
+	zend_long i;
+
+	for (i = 0; i < cache->nshards; i++) {
+		if (!APC_WLOCK(APC_CACHE_SHARD(cache, i))) {
+			while (i-- > 0) {
+				APC_WUNLOCK(APC_CACHE_SHARD(cache, i));
+			}
+			return 0;
+		}
+	}
+
+	return 1;
+} /* }}} */
+
+/* {{{ apc_cache_wunlock_all */
+static void apc_cache_wunlock_all(apc_cache_t* cache) {
+	zend_long i = cache->nshards;
+
+	while (i-- > 0) {
+		APC_WUNLOCK(APC_CACHE_SHARD(cache, i));
+	}
+} /* }}} */
+
+/* {{{ apc_cache_rlock_all */
+PHP_APCU_API void apc_cache_rlock_all(apc_cache_t* cache) {
+	zend_long i;
+
+	for (i = 0; i < cache->nshards; i++) {
+		APC_RLOCK(APC_CACHE_SHARD(cache, i));
+	}
+} /* }}} */
+
+/* {{{ apc_cache_runlock_all */
+PHP_APCU_API void apc_cache_runlock_all(apc_cache_t* cache) {
+	zend_long i = cache->nshards;
+
+	while (i-- > 0) {
+		APC_RUNLOCK(APC_CACHE_SHARD(cache, i));
+	}
+} /* }}} */
+
+/* An entry is hard expired if the creation time if older than the per-entry TTL.
+ * Hard expired entries must be treated indentially to non-existent entries. */
+static zend_bool apc_cache_entry_hard_expired(
+		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
+	return entry->ttl && (time_t) (APC_CACHE_ABS_TIME(cache, entry->ctime) + entry->ttl) < t
+		&& (time_t) (APC_CACHE_ABS_TIME(cache, APC_CACHE_ENTRY_START(entry)) + entry->ttl) < t;
+}
+
+/* An entry is soft expired if no per-entry TTL is set, a global cache TTL is set,
+ * and the access time of the entry is older than the global TTL. Soft expired entries
+ * are accessible by lookup operation, but may be removed from the cache at any time.
+ * Pinned entries never soft expire. */
+static zend_bool apc_cache_entry_soft_expired(
+		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
+	return !entry->ttl && cache->ttl &&
+		!(APC_CACHE_ENTRY_COLD(entry)->flags & APC_CACHE_ENTRY_PINNED) &&
+		(time_t) (APC_CACHE_ABS_TIME(cache, APC_CACHE_ENTRY_COLD(entry)->atime) + cache->ttl) < t;
+}
+
+/* An entry is dead once it is hard expired for longer than its grace period. Entries hard
+ * expired within their grace period may still be returned stale, see apc_cache_entry. */
+static zend_bool apc_cache_entry_dead(
+		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
+	return entry->ttl && (time_t) (APC_CACHE_ABS_TIME(cache, entry->ctime)
+		+ entry->ttl + APC_CACHE_ENTRY_COLD(entry)->grace) < t
+		&& (time_t) (APC_CACHE_ABS_TIME(cache, APC_CACHE_ENTRY_START(entry))
+		+ entry->ttl + APC_CACHE_ENTRY_COLD(entry)->grace) < t;
+}
+
+static zend_bool apc_cache_entry_expired(
+		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
+	return apc_cache_entry_dead(cache, entry, t)
+		|| apc_cache_entry_soft_expired(cache, entry, t);
+}
+
+/* {{{ apc_cache_wlocked_seq_begin
+ Writers make the sequence of a shard odd while they change its chains, so that
+ optimistic readers can tell they raced a writer */
+static inline void apc_cache_wlocked_seq_begin(apc_cache_shard_t *shard) {
+	shard->seq++;
+	APC_MEMORY_BARRIER();
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_seq_end */
+static inline void apc_cache_wlocked_seq_end(apc_cache_shard_t *shard) {
+	APC_MEMORY_BARRIER();
+	shard->seq++;
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_bucket_index
+ Updates the tags of a bucket after its chain changed */
+static void apc_cache_wlocked_bucket_index(apc_cache_bucket_t *bucket)
+{
+	apc_cache_entry_t *entry = bucket->head;
+	int i;
+
+	for (i = 0; i < APC_CACHE_BUCKET_TAGS; i++) {
+		bucket->entries[i] = entry;
+		if (entry) {
+			bucket->tags[i] = APC_CACHE_TAG(ZSTR_HASH(&entry->key));
+			entry = entry->next;
+		} else {
+			bucket->tags[i] = 0;
+		}
+	}
+}
+/* }}} */
+
+/* {{{ apc_cache_wlocked_wheel_link
+ Links entry with a ttl into the timing wheel of its shard, by the first time it is dead */
+static void apc_cache_wlocked_wheel_link(apc_cache_shard_t *shard, apc_cache_entry_t *entry)
+{
+	apc_cache_wheel_t *wheel = &shard->wheel;
+	apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
+	uint32_t expires = APC_CACHE_ENTRY_START(entry) + entry->ttl + cold->grace + 1;
+	uint32_t delta;
+	int level;
+
+	if (expires <= wheel->now) {
+		expires = wheel->now + 1;
+	}
+
+	/* find the lowest level which spans the time left */
+	delta = expires - wheel->now;
+	for (level = 0; level < APC_CACHE_WHEEL_LEVELS - 1; level++) {
+		if (delta < ((uint32_t) 1 << ((level + 1) * APC_CACHE_WHEEL_BITS))) {
+			break;
+		}
+	}
+
+	{
+		apc_cache_entry_t **slot = &wheel->slots[level][
+			(expires >> (level * APC_CACHE_WHEEL_BITS)) & (APC_CACHE_WHEEL_SLOTS - 1)];
+
+		cold->wnext = *slot;
+		cold->wprev = slot;
+		if (*slot) {
+			APC_CACHE_ENTRY_COLD(*slot)->wprev = &cold->wnext;
+		}
+		*slot = entry;
+	}
+
+	wheel->nentries++;
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_wheel_unlink
+ Unlinks entry from the timing wheel of its shard, if it is linked */
+static void apc_cache_wlocked_wheel_unlink(apc_cache_shard_t *shard, apc_cache_entry_t *entry)
+{
+	apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
+
+	if (!cold->wprev) {
+		return;
+	}
+
+	*cold->wprev = cold->wnext;
+	if (cold->wnext) {
+		APC_CACHE_ENTRY_COLD(cold->wnext)->wprev = cold->wprev;
+	}
+	cold->wnext = NULL;
+	cold->wprev = NULL;
+
+	shard->wheel.nentries--;
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_gc_flush
+ Moves the entries removed from shard to the gc list, unless the header lock cannot be
+ taken, they then wait on the shard for the next removal or expunge */
+static void apc_cache_wlocked_gc_flush(apc_cache_t *cache, apc_cache_shard_t *shard)
+{
+	if (!shard->pending || !APC_WLOCK(cache->header)) {
+		return;
+	}
+
+	*cache->header->gc_tail = shard->pending;
+	cache->header->gc_tail = shard->pending_tail;
+	shard->pending = NULL;
+	shard->pending_tail = &shard->pending;
+
+	APC_WUNLOCK(cache->header);
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_remove_entry  */
+static void apc_cache_wlocked_remove_entry(
+		apc_cache_t *cache, apc_cache_shard_t *shard, apc_cache_bucket_t *bucket, apc_cache_entry_t **entry)
+{
+	apc_cache_entry_t *dead = *entry;
+
+	/* think here is safer */
+	apc_cache_wlocked_seq_begin(shard);
+	*entry = (*entry)->next;
+	apc_cache_wlocked_bucket_index(bucket);
+	apc_cache_wlocked_seq_end(shard);
+
+	apc_cache_wlocked_wheel_unlink(shard, dead);
+
+	/* adjust header info, other shards may be doing the same */
+	ATOMIC_SUB(cache->header->mem_size, APC_CACHE_ENTRY_COLD(dead)->mem_size);
+	ATOMIC_DEC(cache->header->nentries);
+	shard->nentries--;
+
+	/* readers may still hold the entry, it goes to the gc list through the pending list of
+	 * the shard. Readers which saw the entry entered their section before it was unlinked,
+	 * so the epoch read after the unlink is at least theirs */
+	APC_MEMORY_BARRIER();
+	dead->next = NULL;
+	APC_CACHE_ENTRY_COLD(dead)->epoch = cache->header->epoch;
+	APC_CACHE_ENTRY_COLD(dead)->dtime = APC_CACHE_REL_TIME(cache, time(0));
+	*shard->pending_tail = dead;
+	shard->pending_tail = &dead->next;
+
+	apc_cache_wlocked_gc_flush(cache, shard);
+}
+/* }}} */
+
+/* {{{ apc_cache_gc */
+static void apc_cache_gc(apc_cache_t* cache)
+{
+	/* This function frees removed entries and retired tables once no worker can
+	 * be reading them anymore.
+	 * Readers announce the epoch they read in, see apc_cache_epoch_enter. Whatever was
+	 * removed in epoch e may only be held by readers of epochs up to e, and the epoch
+	 * only advances past e + 1 once all of them have left.
+	 * The gc list is shared by all shards, and guarded by the header lock. It is
+	 * ordered by epoch, so that the work done is bounded by the entries freed.
+	 */
+	if (!cache->header->gc && !cache->header->retired) {
+		return;
+	}
+
+	if (!APC_WLOCK(cache->header)) {
+		return;
+	}
+
+	/* everything was removed in the current epoch at the latest, it may all be freed two
+	 * epochs later, unless readers hold the epoch back */
+	{
+		zend_ulong wanted = cache->header->epoch + 2;
+		time_t now = time(0);
+
+		while (cache->header->epoch < wanted && apc_cache_epoch_advance(cache, now));
+	}
+
+	/* entries, oldest first, up to the first which may still be read */
+	while (cache->header->gc) {
+		apc_cache_entry_t *dead = cache->header->gc;
+
+		if (APC_CACHE_ENTRY_COLD(dead)->epoch + 2 > cache->header->epoch) {
+			break;
+		}
+
+		cache->header->gc = dead->next;
+		if (!cache->header->gc) {
+			cache->header->gc_tail = &cache->header->gc;
+		}
+		free_entry(cache, dead);
+	}
+
+	/* free slot tables nobody can be walking over anymore */
+	{
+		apc_cache_table_t **table = &cache->header->retired;
+
+		while (*table != NULL) {
+			if ((*table)->epoch + 2 <= cache->header->epoch) {
+				apc_cache_table_t *dead = *table;
+
+				*table = (*table)->next;
+				cache->sma->sfree(dead);
+			} else {
+				table = &(*table)->next;
+			}
+		}
+	}
+
+	APC_WUNLOCK(cache->header);
+}
+/* }}} */
+
+/* {{{ apc_cache_wlocked_retire_table
+ Frees a table the entries were migrated away from, optimistic readers may
+ still be walking over it though, in which case the gc frees it once they left */
+static void apc_cache_wlocked_retire_table(apc_cache_t *cache, apc_cache_table_t *table)
+{
+	if (!table->allocated) {
+		/* initial tables are part of the cache structures */
+		return;
+	}
+
+	if (!cache->optimistic_reads) {
+		cache->sma->sfree(table);
+	} else if (APC_WLOCK(cache->header)) {
+		table->next = cache->header->retired;
+		table->epoch = cache->header->epoch;
+		cache->header->retired = table;
+		APC_WUNLOCK(cache->header);
+	}
+}
+/* }}} */
+
+/* {{{ apc_cache_reclaim_cleared
+ Frees the entries of the tables swapped out by apc_cache_clear, nslots slots at a time,
+ or all of them when nslots is 0. Nobody can reach the cleared tables anymore but the
+ readers which entered before the clear, so they are only waited for */
+static void apc_cache_reclaim_cleared(apc_cache_t *cache, zend_long nslots)
+{
+	apc_cache_header_t *header = cache->header;
+	time_t now = time(0);
+
+	if (!header->cleared) {
+		return;
+	}
+
+	if (!APC_WLOCK(header)) {
+		return;
+	}
+
+	while (header->cleared) {
+		apc_cache_table_t *table = header->cleared;
+
+		while (header->epoch < table->epoch + 2 && apc_cache_epoch_advance(cache, now));
+		if (header->epoch < table->epoch + 2) {
+			break;
+		}
+
+		while (header->cleared_slot < table->nslots) {
+			apc_cache_entry_t *entry = table->slots[header->cleared_slot++].head;
+
+			while (entry) {
+				apc_cache_entry_t *dead = entry;
+
+				entry = entry->next;
+				free_entry(cache, dead);
+			}
+
+			if (nslots && --nslots == 0) {
+				break;
+			}
+		}
+
+		if (header->cleared_slot < table->nslots) {
+			break;
+		}
+
+		header->cleared = table->next;
+		header->cleared_slot = 0;
+
+		/* initial tables are part of the cache structures */
+		if (table->allocated) {
+			cache->sma->sfree(table);
+		}
+	}
+
+	APC_WUNLOCK(header);
+}
+/* }}} */
+
+/* {{{ apc_cache_wlocked_rehash_slot
+ Moves the entries in slot i of the old table to the table of the shard */
+static void apc_cache_wlocked_rehash_slot(apc_cache_t *cache, apc_cache_shard_t *shard, zend_ulong i)
+{
+	apc_cache_bucket_t *bucket = &shard->old_table->slots[i];
+	apc_cache_entry_t *entry = bucket->head;
+
+	if (!entry) {
+		return;
+	}
+
+	while (entry) {
+		apc_cache_entry_t *next = entry->next;
+		apc_cache_bucket_t *dest = &shard->table->slots[
+			apc_cache_table_slot(cache, shard->table, ZSTR_HASH(&entry->key))];
+
+		entry->next = dest->head;
+		dest->head = entry;
+		apc_cache_wlocked_bucket_index(dest);
+		entry = next;
+	}
+
+	bucket->head = NULL;
+	apc_cache_wlocked_bucket_index(bucket);
+}
+/* }}} */
+
+/* {{{ apc_cache_wlocked_bucket
+ Returns the bucket of the slot for hash h to a writer. While the table of the shard
+ grows, the slot of h and a few more are migrated first, so writers never have to
+ look at the old table */
+static apc_cache_bucket_t *apc_cache_wlocked_bucket(apc_cache_t *cache, apc_cache_shard_t *shard, zend_ulong h)
+{
+	if (shard->old_table) {
+		apc_cache_table_t *old_table = shard->old_table;
+		zend_long n = APC_CACHE_REHASH_STEP;
+
+		apc_cache_wlocked_seq_begin(shard);
+
+		apc_cache_wlocked_rehash_slot(
+			cache, shard, apc_cache_table_slot(cache, old_table, h));
+
+		while (n-- > 0 && shard->rehash_idx < old_table->nslots) {
+			apc_cache_wlocked_rehash_slot(cache, shard, shard->rehash_idx++);
+		}
+
+		if (shard->rehash_idx >= old_table->nslots) {
+			shard->old_table = NULL;
+		}
+
+		apc_cache_wlocked_seq_end(shard);
+
+		if (!shard->old_table) {
+			apc_cache_wlocked_retire_table(cache, old_table);
+		}
+	}
+
+	return &shard->table->slots[apc_cache_table_slot(cache, shard->table, h)];
+}
+/* }}} */
+
+/* {{{ apc_cache_wlocked_wheel_expire
+ Removes the entries of a slot detached from the timing wheel which are expired at now,
+ entries which are not are linked again (at a lower level when the slot was cascaded).
+ Each entry is marked unlinked before it is removed, the rest of the list is not reachable
+ from the wheel anymore. Returns the memory used by the removed entries */
+static size_t apc_cache_wlocked_wheel_expire(
+		apc_cache_t *cache, apc_cache_shard_t *shard, apc_cache_entry_t *list, uint32_t now)
+{
+	size_t reclaimed = 0;
+
+	while (list) {
+		apc_cache_entry_t *entry = list;
+		apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
+
+		list = cold->wnext;
+		cold->wnext = NULL;
+		cold->wprev = NULL;
+		shard->wheel.nentries--;
+
+		if ((uint32_t) (APC_CACHE_ENTRY_START(entry) + entry->ttl + cold->grace + 1) <= now) {
+			/* find the link to the entry in its chain */
+			zend_ulong h = ZSTR_HASH(&entry->key);
+			apc_cache_bucket_t *bucket = apc_cache_wlocked_bucket(cache, shard, h);
+			apc_cache_entry_t **link = &bucket->head;
+
+			while (*link && *link != entry) {
+				link = &(*link)->next;
+			}
+
+			if (*link) {
+				reclaimed += cold->mem_size;
+				apc_cache_wlocked_remove_entry(cache, shard, bucket, link);
+			}
+		} else {
+			apc_cache_wlocked_wheel_link(shard, entry);
+		}
+	}
+
+	return reclaimed;
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_wheel_level_empty */
+static zend_bool apc_cache_wlocked_wheel_level_empty(apc_cache_wheel_t *wheel, int level)
+{
+	int i;
+
+	for (i = 0; i < APC_CACHE_WHEEL_SLOTS; i++) {
+		if (wheel->slots[level][i]) {
+			return 0;
+		}
+	}
+	return 1;
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_wheel_advance
+ Advances the timing wheel of shard to t, removing the entries which expired meanwhile.
+ Ticks over which the lower levels are empty are skipped, so that the work done is
+ bounded by the expired entries and the slots of higher levels passed.
+ Returns the memory used by the removed entries */
+static size_t apc_cache_wlocked_wheel_advance(apc_cache_t *cache, apc_cache_shard_t *shard, time_t t)
+{
+	apc_cache_wheel_t *wheel = &shard->wheel;
+	uint32_t target = APC_CACHE_REL_TIME(cache, t);
+	size_t reclaimed = 0;
+
+	while (wheel->now < target) {
+		uint32_t now;
+		int level;
+
+		if (!wheel->nentries) {
+			wheel->now = target;
+			break;
+		}
+
+		/* skip to the tick before the next cascade of the lowest level with entries */
+		for (level = 0; level < APC_CACHE_WHEEL_LEVELS; level++) {
+			if (!apc_cache_wlocked_wheel_level_empty(wheel, level)) {
+				break;
+			}
+		}
+
+		if (level > 0) {
+			uint32_t span = (uint32_t) 1 << (level * APC_CACHE_WHEEL_BITS);
+			uint32_t next = (wheel->now | (span - 1)) + 1;
+
+			if (level == APC_CACHE_WHEEL_LEVELS || next == 0 || next > target) {
+				wheel->now = target;
+				break;
+			}
+			wheel->now = next - 1;
+		}
+
+		now = ++wheel->now;
+
+		/* move the entries of the slots whose span starts now down, highest level first */
+		for (level = APC_CACHE_WHEEL_LEVELS - 1; level > 0; level--) {
+			if ((now & (((uint32_t) 1 << (level * APC_CACHE_WHEEL_BITS)) - 1)) == 0) {
+				apc_cache_entry_t **slot = &wheel->slots[level][
+					(now >> (level * APC_CACHE_WHEEL_BITS)) & (APC_CACHE_WHEEL_SLOTS - 1)];
+				apc_cache_entry_t *list = *slot;
+
+				*slot = NULL;
+				reclaimed += apc_cache_wlocked_wheel_expire(cache, shard, list, now);
+			}
+		}
+
+		/* expire the entries of the slot of now */
+		{
+			apc_cache_entry_t **slot = &wheel->slots[0][now & (APC_CACHE_WHEEL_SLOTS - 1)];
+			apc_cache_entry_t *list = *slot;
+
+			*slot = NULL;
+			reclaimed += apc_cache_wlocked_wheel_expire(cache, shard, list, now);
+		}
 	}
-	return *(k-1);
-}
-/* }}} */
-
-static void free_entry(apc_cache_t *cache, apc_cache_entry_t *entry)
-{
-	apc_pool_destroy(entry->pool, cache->sma);
-}
 
-/* {{{ apc_cache_hash_slot
- Note: These calculations can and should be done outside of a lock */
-static void apc_cache_hash_slot(
-		apc_cache_t* cache, zend_string *key, zend_ulong* hash, zend_ulong* slot) {
-	*hash = ZSTR_HASH(key);
-	*slot = *hash % cache->nslots;
+	return reclaimed;
 } /* }}} */
 
-/* An entry is hard expired if the creation time if older than the per-entry TTL.
- * Hard expired entries must be treated indentially to non-existent entries. */
-static zend_bool apc_cache_entry_hard_expired(apc_cache_entry_t *entry, time_t t) {
-	return entry->ttl && (time_t) (entry->ctime + entry->ttl) < t;
-}
+/* {{{ apc_cache_table_init
+ Initializes the table at the start of size bytes of zeroed memory */
+static apc_cache_table_t *apc_cache_table_init(void *mem, zend_long nslots, zend_bool pow2_slots, zend_bool allocated)
+{
+	apc_cache_table_t *table = (apc_cache_table_t *) mem;
+	char *slots = ((char *) mem) + ALIGNWORD(sizeof(apc_cache_table_t));
 
-/* An entry is soft expired if no per-entry TTL is set, a global cache TTL is set,
- * and the access time of the entry is older than the global TTL. Soft expired entries
- * are accessible by lookup operation, but may be removed from the cache at any time. */
-static zend_bool apc_cache_entry_soft_expired(
-		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
-	return !entry->ttl && cache->ttl && (time_t) (entry->atime + cache->ttl) < t;
-}
+	/* buckets start on a cache line boundary */
+	slots += APC_CACHE_LINE_SIZE - (((zend_uintptr_t) slots) % APC_CACHE_LINE_SIZE);
 
-static zend_bool apc_cache_entry_expired(
-		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
-	return apc_cache_entry_hard_expired(entry, t)
-		|| apc_cache_entry_soft_expired(cache, entry, t);
+	table->nslots = nslots;
+	table->mask = pow2_slots ? nslots - 1 : 0;
+	table->allocated = allocated;
+	table->slots = (apc_cache_bucket_t *) slots;
+
+	return table;
 }
+/* }}} */
 
-/* {{{ apc_cache_wlocked_remove_entry  */
-static void apc_cache_wlocked_remove_entry(apc_cache_t *cache, apc_cache_entry_t **entry)
+/* {{{ apc_cache_grow
+ Starts growing the table of a shard that is loaded beyond APC_CACHE_MAX_LOAD,
+ entries are then migrated incrementally by apc_cache_wlocked_bucket.
+ Growing is skipped while memory is short: an allocation the SMA cannot serve would
+ expunge the cache, emptying the very table that was to grow.
+ Must be called without holding any lock */
+static void apc_cache_grow(apc_cache_t *cache, apc_cache_shard_t *shard)
 {
-	apc_cache_entry_t *dead = *entry;
-
-	/* think here is safer */
-	*entry = (*entry)->next;
+	apc_cache_table_t *table;
+	zend_long nslots;
+	zend_ulong size, avail;
 
-	/* adjust header info */
-	if (cache->header->mem_size)
-		cache->header->mem_size -= dead->mem_size;
+	/* peek without the lock, this is checked again below */
+	if (shard->old_table || shard->nentries <= shard->table->nslots * APC_CACHE_MAX_LOAD) {
+		return;
+	}
 
-	if (cache->header->nentries)
-		cache->header->nentries--;
+	nslots = make_table_size(cache->pow2_slots, shard->table->nslots * 2 - 1);
+	if (nslots <= shard->table->nslots) {
+		/* largest size already */
+		return;
+	}
 
-	/* remove if there are no references */
-	if (dead->ref_count <= 0) {
-		free_entry(cache, dead);
-	} else {
-		/* add to gc if there are still refs */
-		dead->next = cache->header->gc;
-		dead->dtime = time(0);
-		cache->header->gc = dead;
+	size = APC_CACHE_TABLE_SIZE(nslots);
+	avail = cache->sma->get_avail_mem();
+	if (avail < size + (cache->sma->size * cache->sma->num) / APC_CACHE_GROW_FREE
+			|| !cache->sma->get_avail_size(size)) {
+		return;
 	}
-}
-/* }}} */
 
-/* {{{ apc_cache_wlocked_gc */
-static void apc_cache_wlocked_gc(apc_cache_t* cache)
-{
-	/* This function scans the list of removed cache entries and deletes any
-	 * entry whose reference count is zero  or that has been on the gc
-	 * list for more than cache->gc_ttl seconds
-	 *   (we issue a warning in the latter case).
-	 */
-	if (!cache->header->gc) {
+	table = cache->sma->smalloc(size);
+	if (!table) {
 		return;
 	}
 
-	{
-		apc_cache_entry_t **entry = &cache->header->gc;
-		time_t now = time(0);
+	memset(table, 0, size);
+	table = apc_cache_table_init(table, nslots, cache->pow2_slots, 1);
 
-		while (*entry != NULL) {
-			time_t gc_sec = cache->gc_ttl ? (now - (*entry)->dtime) : 0;
+	if (!APC_WLOCK(shard)) {
+		cache->sma->sfree(table);
+		return;
+	}
 
-			if (!(*entry)->ref_count || gc_sec > (time_t)cache->gc_ttl) {
-				apc_cache_entry_t *dead = *entry;
+	if (!shard->old_table && shard->table->nslots < nslots &&
+		shard->nentries > shard->table->nslots * APC_CACHE_MAX_LOAD) {
+		apc_cache_wlocked_seq_begin(shard);
+		shard->old_table = shard->table;
+		shard->rehash_idx = 0;
+		shard->table = table;
+		apc_cache_wlocked_seq_end(shard);
 
-				/* good ol' whining */
-				if (dead->ref_count > 0) {
-					apc_debug(
-						"GC cache entry '%s' was on gc-list for %ld seconds",
-						ZSTR_VAL(dead->key), gc_sec
-					);
-				}
+		table = NULL;
+	}
 
-				/* set next entry */
-				*entry = (*entry)->next;
+	APC_WUNLOCK(shard);
 
-				/* free entry */
-				free_entry(cache, dead);
-			} else {
-				entry = &(*entry)->next;
-			}
-		}
+	if (table) {
+		/* somebody else was faster */
+		cache->sma->sfree(table);
 	}
 }
 /* }}} */
@@ -258,13 +1090,42 @@ PHP_APCU_API int APC_UNSERIALIZER_NAME(php) (APC_UNSERIALIZER_ARGS)
 } /* }}} */
 
 /* {{{ apc_cache_create */
-PHP_APCU_API apc_cache_t* apc_cache_create(apc_sma_t* sma, apc_serializer_t* serializer, zend_long size_hint, zend_long gc_ttl, zend_long ttl, zend_long smart, zend_bool defend) {
+PHP_APCU_API apc_cache_t* apc_cache_create(apc_sma_t* sma, apc_serializer_t* serializer, zend_long size_hint, zend_long gc_ttl, zend_long ttl, zend_long smart, zend_long defend, zend_long nshards, zend_bool pow2_slots, zend_bool admission, zend_long nreaders) {
 	apc_cache_t* cache;
 	zend_long cache_size;
 	zend_long nslots;
+	zend_long sketch_width = 0;
+	zend_long slam_width = 0;
+	zend_long i;
+	char *shards;
+	char *counters;
+	char *readers;
+	char *slam_keys;
+	char *sketch;
+	char *tables;
+
+	/* there is always at least one shard */
+	if (nshards < 1) {
+		nshards = 1;
+	}
+
+	if (nreaders < 1) {
+		nreaders = APC_CACHE_READERS;
+	}
+
+	/* calculate number of slots per shard, every bucket indexes a few entries */
+	nslots = make_table_size(pow2_slots,
+		(size_hint > 0 ? size_hint : 2000) / nshards / APC_CACHE_BUCKET_TAGS);
+
+	/* slam defense remembers inserts in a table of its own */
+	if (defend > 0) {
+		slam_width = make_pow2(defend);
+	}
 
-	/* calculate number of slots */
-	nslots = make_prime(size_hint > 0 ? size_hint : 2000);
+	/* the sketch has a few counters for every entry expected */
+	if (admission) {
+		sketch_width = make_pow2(2 * (size_hint > 0 ? size_hint : 2000));
+	}
 
 	/* allocate pointer by normal means */
 	cache = (apc_cache_t*) apc_emalloc(sizeof(apc_cache_t));
@@ -274,8 +1135,14 @@ PHP_APCU_API apc_cache_t* apc_cache_create(apc_sma_t* sma, apc_serializer_t* ser
 		return NULL;
 	}
 
-	/* calculate cache size for shm allocation */
-	cache_size = sizeof(apc_cache_header_t) + nslots*sizeof(apc_cache_entry_t *);
+	/* calculate cache size for shm allocation, including room to align the shards */
+	cache_size = sizeof(apc_cache_header_t) + APC_CACHE_LINE_SIZE
+		+ nshards * APC_CACHE_SHARD_SIZE
+		+ APC_CACHE_COUNTERS * sizeof(apc_cache_counters_t)
+		+ nreaders * sizeof(apc_cache_reader_t)
+		+ slam_width * sizeof(apc_cache_slam_key_t)
+		+ APC_CACHE_SKETCH_DEPTH * sketch_width
+		+ nshards * APC_CACHE_TABLE_SIZE(nslots);
 
 	/* allocate shm */
 	cache->shmaddr = sma->smalloc(cache_size);
@@ -291,215 +1158,655 @@ PHP_APCU_API apc_cache_t* apc_cache_create(apc_sma_t* sma, apc_serializer_t* ser
 	/* set default header */
 	cache->header = (apc_cache_header_t*) cache->shmaddr;
 
-	cache->header->nhits = 0;
-	cache->header->nmisses = 0;
 	cache->header->nentries = 0;
 	cache->header->nexpunges = 0;
 	cache->header->gc = NULL;
+	cache->header->gc_tail = &cache->header->gc;
+	cache->header->epoch = 0;
+	cache->header->epoch_held = 0;
+	cache->header->retired = NULL;
+	cache->header->cleared = NULL;
+	cache->header->cleared_slot = 0;
+	cache->header->generation = 0;
 	cache->header->stime = time(NULL);
+	cache->header->tbase = cache->header->stime - 1;
 	cache->header->state |= APC_CACHE_ST_NONE;
 
+	/* shards start on the first cache line boundary after the header */
+	shards = ((char*) cache->shmaddr) + sizeof(apc_cache_header_t);
+	shards += APC_CACHE_LINE_SIZE - (((zend_uintptr_t) shards) % APC_CACHE_LINE_SIZE);
+
+	/* counter shards follow the lock shards, zeroed with the rest of shm */
+	counters = shards + nshards * APC_CACHE_SHARD_SIZE;
+
+	/* the slots of read sections follow the counter shards, all free */
+	readers = counters + APC_CACHE_COUNTERS * sizeof(apc_cache_counters_t);
+
+	/* the slam defense table follows the read sections */
+	slam_keys = readers + nreaders * sizeof(apc_cache_reader_t);
+
+	/* the sketch follows the slam defense table */
+	sketch = slam_keys + slam_width * sizeof(apc_cache_slam_key_t);
+
+	/* initial slot tables follow the sketch */
+	tables = sketch + APC_CACHE_SKETCH_DEPTH * sketch_width;
+
 	/* set cache options */
-	cache->slots = (apc_cache_entry_t **) (((char*) cache->shmaddr) + sizeof(apc_cache_header_t));
+	cache->shards = (apc_cache_shard_t *) shards;
+	cache->nshards = nshards;
+	cache->counters = (apc_cache_counters_t *) counters;
+	cache->readers = (apc_cache_reader_t *) readers;
+	cache->nreaders = nreaders;
+	cache->reader_owner = 0;
+	cache->sketch = admission ? (unsigned char *) sketch : NULL;
+	cache->sketch_mask = admission ? sketch_width - 1 : 0;
 	cache->sma = sma;
 	cache->serializer = serializer;
-	cache->nslots = nslots;
+	cache->nslots = nslots * nshards;
 	cache->gc_ttl = gc_ttl;
 	cache->ttl = ttl;
 	cache->smart = smart;
-	cache->defend = defend;
+	cache->defend = slam_width > 0;
+	cache->slam_keys = slam_width ? (apc_cache_slam_key_t *) slam_keys : NULL;
+	cache->slam_mask = slam_width ? slam_width - 1 : 0;
+	cache->optimistic_reads = 1;
+	cache->pow2_slots = pow2_slots;
+	cache->count_lookups = 1;
+	cache->atime_granularity = 0;
+	cache->hits_sample = 1;
+	cache->eviction = APC_CACHE_EVICT_EXPUNGE;
+	cache->sweep_slots = 0;
+	cache->sweep_interval = 0;
+	cache->entry_wait = 1000;
+	cache->ttl_jitter = 0;
 
 	/* header lock */
 	CREATE_LOCK(&cache->header->lock);
 
-	/* zero slots */
-	memset(cache->slots, 0, sizeof(apc_cache_entry_t *) * nslots);
+	/* shard locks and slots, slots were zeroed with the rest of shm */
+	for (i = 0; i < nshards; i++) {
+		apc_cache_shard_t *shard = APC_CACHE_SHARD(cache, i);
+
+		CREATE_LOCK(&shard->lock);
+		shard->table = apc_cache_table_init(
+			tables + i * APC_CACHE_TABLE_SIZE(nslots), nslots, pow2_slots, 0);
+		shard->old_table = NULL;
+		shard->nentries = 0;
+		shard->pending = NULL;
+		shard->pending_tail = &shard->pending;
+	}
 
 	return cache;
 } /* }}} */
 
 static inline zend_bool apc_cache_wlocked_insert(
-		apc_cache_t *cache, apc_cache_entry_t *new_entry, zend_bool exclusive) {
-	zend_string *key = new_entry->key;
-	time_t t = new_entry->ctime;
+		apc_cache_t *cache, apc_cache_entry_t *new_entry, time_t t, zend_bool exclusive) {
+	zend_string *key = &new_entry->key;
 
 	/* process deleted list  */
-	apc_cache_wlocked_gc(cache);
+	apc_cache_gc(cache);
 
 	/* make the insertion */
 	{
+		apc_cache_shard_t *shard;
+		apc_cache_bucket_t *bucket;
 		apc_cache_entry_t **entry;
-		zend_ulong h, s;
+		zend_ulong h;
 
 		/* calculate hash and entry */
-		apc_cache_hash_slot(cache, key, &h, &s);
+		apc_cache_hash_shard(cache, key, &h, &shard);
+
+		/* remove the entries of this shard which expired since the last insertion */
+		apc_cache_wlocked_wheel_advance(cache, shard, t);
 
-		entry = &cache->slots[s];
+		bucket = apc_cache_wlocked_bucket(cache, shard, h);
+		entry = &bucket->head;
 		while (*entry) {
 			/* check for a match by hash and string */
-			if ((ZSTR_HASH((*entry)->key) == h) &&
-				ZSTR_LEN((*entry)->key) == ZSTR_LEN(key) &&
-				memcmp(ZSTR_VAL((*entry)->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0) {
+			if ((ZSTR_HASH(&(*entry)->key) == h) &&
+				ZSTR_LEN(&(*entry)->key) == ZSTR_LEN(key) &&
+				memcmp(ZSTR_VAL(&(*entry)->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0) {
 
 				/*
 				 * At this point we have found the user cache entry.  If we are doing
 				 * an exclusive insert (apc_add) we are going to bail right away if
-				 * the user entry already exists and is hard expired.
+				 * the user entry already exists and is not hard expired, unless it
+				 * only records the key as missing.
 				 */
-				if (exclusive && !apc_cache_entry_hard_expired(*entry, t)) {
+				if (exclusive && !APC_CACHE_ENTRY_MISSING(*entry) &&
+					!apc_cache_entry_hard_expired(cache, *entry, t)) {
 					return 0;
 				}
 
-				apc_cache_wlocked_remove_entry(cache, entry);
-				break;
-			}
+				apc_cache_wlocked_remove_entry(cache, shard, bucket, entry);
+				break;
+			}
+
+			/*
+			 * This is a bit nasty. The idea here is to do runtime cleanup of the linked list of
+			 * entry entries so we don't always have to skip past a bunch of stale entries.
+			 */
+			if (apc_cache_entry_expired(cache, *entry, t)) {
+				apc_cache_wlocked_remove_entry(cache, shard, bucket, entry);
+				continue;
+			}
+
+			/* set next entry */
+			entry = &(*entry)->next;
+		}
+
+		/* link in new entry */
+		new_entry->next = *entry;
+		apc_cache_wlocked_seq_begin(shard);
+		*entry = new_entry;
+		apc_cache_wlocked_bucket_index(bucket);
+		apc_cache_wlocked_seq_end(shard);
+
+		if (new_entry->ttl) {
+			apc_cache_wlocked_wheel_link(shard, new_entry);
+		}
+
+		/* set value size from pool size, entries of missing keys have no pool */
+		APC_CACHE_ENTRY_COLD(new_entry)->mem_size = APC_CACHE_ENTRY_COLD(new_entry)->pool
+			? apc_pool_size(APC_CACHE_ENTRY_COLD(new_entry)->pool)
+			: APC_CACHE_ENTRY_SIZE(ZSTR_LEN(key));
+		ATOMIC_ADD(cache->header->mem_size, APC_CACHE_ENTRY_COLD(new_entry)->mem_size);
+		ATOMIC_INC(cache->header->nentries);
+		ATOMIC_INC(cache->header->ninserts);
+		shard->nentries++;
+	}
+
+	return 1;
+}
+
+static zend_bool apc_cache_make_copy_in_context(
+		apc_cache_t* cache, apc_context_t* context, apc_pool_type pool_type);
+static zend_bool apc_cache_destroy_context(apc_context_t *context);
+static apc_cache_entry_t *apc_cache_make_entry(
+		apc_cache_t *cache, apc_context_t *ctxt, zend_string *key,
+		const zval* val, const int32_t ttl, zend_long jitter, time_t t);
+static apc_cache_entry_t *apc_cache_init_entry(
+		apc_cache_t *cache, void *mem, zend_string *key,
+		const int32_t ttl, time_t t);
+
+/* Stores the value generated by apc_cache_entry, which also sets the grace and delta of the entry */
+static inline zend_bool apc_cache_store_internal(
+		apc_cache_t *cache, zend_string *key, const zval *val,
+		const int32_t ttl, const uint32_t grace, const uint32_t delta, const zend_bool exclusive) {
+	apc_cache_shard_t *shard;
+	apc_cache_entry_t *entry;
+	time_t t = apc_time();
+	apc_context_t ctxt={0,};
+	zend_bool ret = 0;
+
+	if (apc_cache_defense(cache, key, t)) {
+		return 0;
+	}
+
+	/* initialize a context suitable for making an insert */
+	if (!apc_cache_make_copy_in_context(cache, &ctxt, APC_SMALL_POOL)) {
+		return 0;
+	}
+
+	/* initialize the entry for insertion */
+	entry = apc_cache_make_entry(cache, &ctxt, key, val, ttl, cache->ttl_jitter, t);
+	if (!entry) {
+		apc_cache_destroy_context(&ctxt);
+		return 0;
+	}
+
+	/* only entries with a ttl expire, and go stale */
+	if (ttl) {
+		APC_CACHE_ENTRY_COLD(entry)->grace = grace;
+	}
+	APC_CACHE_ENTRY_COLD(entry)->delta = delta;
+
+	/* execute an insertion */
+	shard = apc_cache_key_shard(cache, key);
+	if (!APC_WLOCK(shard)) {
+		apc_cache_destroy_context(&ctxt);
+		return 0;
+	}
+
+	php_apc_try {
+		ret = apc_cache_wlocked_insert(cache, entry, t, exclusive);
+	} php_apc_finally {
+		APC_WUNLOCK(shard);
+	} php_apc_end_try();
+
+	if (!ret) {
+		apc_cache_destroy_context(&ctxt);
+		return 0;
+	}
+
+	/* grow the table of the shard when it became too crowded */
+	apc_cache_grow(cache, shard);
+
+	return ret;
+}
+
+/* Returns a mask of the indexed entries of bucket with a matching tag */
+static inline unsigned int apc_cache_bucket_match(apc_cache_bucket_t *bucket, uint32_t tag) {
+#ifdef APC_CACHE_BUCKET_SIMD
+	__m128i tags = _mm_loadu_si128((const __m128i *) bucket->tags);
+
+	return (unsigned int) _mm_movemask_ps(
+		_mm_castsi128_ps(_mm_cmpeq_epi32(tags, _mm_set1_epi32((int) tag))));
+#else
+	unsigned int match = 0;
+	int i;
+
+	for (i = 0; i < APC_CACHE_BUCKET_TAGS; i++) {
+		match |= (bucket->tags[i] == tag) << i;
+	}
+
+	return match;
+#endif
+}
+
+/* Find entry in the slot of a table */
+static inline apc_cache_entry_t *apc_cache_table_find(
+		apc_cache_t *cache, apc_cache_table_t *table, zend_string *key, zend_ulong h) {
+	apc_cache_bucket_t *bucket = &table->slots[apc_cache_table_slot(cache, table, h)];
+	unsigned int match = apc_cache_bucket_match(bucket, APC_CACHE_TAG(h));
+	apc_cache_entry_t *entry = NULL;
+	int i;
+
+	/* only entries with a matching tag are looked at */
+	for (i = 0; i < APC_CACHE_BUCKET_TAGS; i++) {
+		entry = bucket->entries[i];
+		if (!entry) {
+			return NULL;
+		}
+
+		if ((match & (1U << i)) &&
+			h == ZSTR_HASH(&entry->key) &&
+			ZSTR_LEN(&entry->key) == ZSTR_LEN(key) &&
+			memcmp(ZSTR_VAL(&entry->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0) {
+			return entry;
+		}
+	}
+
+	/* longer chains go on past the indexed entries */
+	entry = entry->next;
+	while (entry) {
+		/* check for a matching key by has and identifier */
+		if (h == ZSTR_HASH(&entry->key) &&
+			ZSTR_LEN(&entry->key) == ZSTR_LEN(key) &&
+			memcmp(ZSTR_VAL(&entry->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0) {
+			return entry;
+		}
+
+		entry = entry->next;
+	}
+
+	return NULL;
+}
+
+/* Find entry in the shard, regardless of expiry */
+static inline apc_cache_entry_t *apc_cache_rlocked_lookup(
+		apc_cache_t *cache, apc_cache_shard_t *shard, zend_string *key, zend_ulong h) {
+	apc_cache_table_t *old_table;
+	apc_cache_entry_t *entry = apc_cache_table_find(cache, shard->table, key, h);
+
+	/* while the table grows, the entry may not have been migrated yet */
+	if (!entry && (old_table = shard->old_table) != NULL) {
+		entry = apc_cache_table_find(cache, old_table, key, h);
+	}
+
+	return entry;
+}
+
+/* Find entry, without updating stat counters or access time
+ When stale is set, entries hard expired within their grace period are found too, and
+ stale tells whether the entry found is.
+ Optimistic readers call this without holding the shard lock, see apc_cache_optimistic_find */
+static inline apc_cache_entry_t *apc_cache_rlocked_find_stale(
+		apc_cache_t *cache, zend_string *key, time_t t, zend_bool *stale) {
+	apc_cache_shard_t *shard;
+	apc_cache_entry_t *entry;
+	zend_ulong h;
+
+	/* calculate hash and shard */
+	apc_cache_hash_shard(cache, key, &h, &shard);
+
+	entry = apc_cache_rlocked_lookup(cache, shard, key, h);
+
+	/* Check to make sure this entry isn't expired by a hard TTL */
+	if (entry && apc_cache_entry_hard_expired(cache, entry, t)) {
+		if (!stale || apc_cache_entry_dead(cache, entry, t)) {
+			return NULL;
+		}
+		*stale = 1;
+	}
+
+	return entry;
+}
+
+static inline apc_cache_entry_t *apc_cache_rlocked_find_nostat(
+		apc_cache_t *cache, zend_string *key, time_t t) {
+	return apc_cache_rlocked_find_stale(cache, key, t, NULL);
+}
+
+/* {{{ apc_cache_sketch_counters
+ Sets the counter of every row of the sketch for hash, rows are indexed by combining
+ two halves of the mixed hash */
+static inline void apc_cache_sketch_counters(
+		apc_cache_t *cache, zend_ulong hash, unsigned char **counters) {
+	zend_ulong mixed = apc_cache_hash_mix(hash);
+	uint32_t h1 = (uint32_t) mixed;
+	uint32_t h2 = ((uint32_t) (mixed >> (SIZEOF_ZEND_LONG * 4))) | 1;
+	int i;
+
+	for (i = 0; i < APC_CACHE_SKETCH_DEPTH; i++) {
+		counters[i] = &cache->sketch[
+			i * (cache->sketch_mask + 1) + ((h1 + i * h2) & cache->sketch_mask)];
+	}
+} /* }}} */
+
+/* {{{ apc_cache_sketch_estimate
+ Returns the estimated frequency of hash */
+static uint32_t apc_cache_sketch_estimate(apc_cache_t *cache, zend_ulong hash) {
+	unsigned char *counters[APC_CACHE_SKETCH_DEPTH];
+	uint32_t estimate = UCHAR_MAX;
+	int i;
+
+	apc_cache_sketch_counters(cache, hash, counters);
+	for (i = 0; i < APC_CACHE_SKETCH_DEPTH; i++) {
+		if (*counters[i] < estimate) {
+			estimate = *counters[i];
+		}
+	}
+
+	return estimate;
+} /* }}} */
+
+/* {{{ apc_cache_sketch_record
+ Records an occurence of hash, only the smallest counters are incremented (conservative update).
+ Counters are not updated atomically, the odd lost increment does not matter to an estimate.
+ Occurences are counted in the counter shard of the worker, see apc_cache_sketch_age */
+static void apc_cache_sketch_record(apc_cache_t *cache, zend_ulong hash) {
+	unsigned char *counters[APC_CACHE_SKETCH_DEPTH];
+	unsigned char estimate = UCHAR_MAX;
+	int i;
+
+	apc_cache_sketch_counters(cache, hash, counters);
+	for (i = 0; i < APC_CACHE_SKETCH_DEPTH; i++) {
+		if (*counters[i] < estimate) {
+			estimate = *counters[i];
+		}
+	}
+
+	if (estimate < UCHAR_MAX) {
+		for (i = 0; i < APC_CACHE_SKETCH_DEPTH; i++) {
+			if (*counters[i] == estimate) {
+				*counters[i] = estimate + 1;
+			}
+		}
+	}
+
+	ATOMIC_INC(apc_cache_worker_counters(cache)->sketch_additions);
+} /* }}} */
+
+/* {{{ apc_cache_sketch_additions
+ Returns the occurences recorded since the sketch was last aged, over all counter shards */
+static zend_long apc_cache_sketch_additions(apc_cache_t *cache) {
+	zend_long additions = 0;
+	int i;
+
+	for (i = 0; i < APC_CACHE_COUNTERS; i++) {
+		additions += cache->counters[i].sketch_additions;
+	}
+
+	return additions;
+} /* }}} */
+
+/* {{{ apc_cache_sketch_age
+ Once the sketch recorded APC_CACHE_SKETCH_SAMPLE occurences per counter, every counter is
+ halved so that the frequencies follow the recent history. Called on stores, never on lookups,
+ as aging walks the whole sketch under the header lock */
+static void apc_cache_sketch_age(apc_cache_t *cache) {
+	zend_long width = cache->sketch_mask + 1;
+	zend_long i;
+
+	if (apc_cache_sketch_additions(cache) < width * APC_CACHE_SKETCH_SAMPLE) {
+		return;
+	}
+
+	if (!APC_WLOCK(cache->header)) {
+		return;
+	}
+
+	/* whoever gets the lock first ages the sketch */
+	if (apc_cache_sketch_additions(cache) >= width * APC_CACHE_SKETCH_SAMPLE) {
+		for (i = 0; i < APC_CACHE_SKETCH_DEPTH * width; i++) {
+			cache->sketch[i] >>= 1;
+		}
+
+		/* occurences recorded meanwhile are kept for the next round */
+		for (i = 0; i < APC_CACHE_COUNTERS; i++) {
+			zend_long additions = cache->counters[i].sketch_additions;
+
+			ATOMIC_SUB(cache->counters[i].sketch_additions, additions);
+		}
+	}
+
+	APC_WUNLOCK(cache->header);
+} /* }}} */
+
+/* {{{ apc_cache_worker_random
+ Returns the next number of a generator private to the worker (xorshift), never 0 */
+static inline uint32_t apc_cache_worker_random(void) {
+	uint32_t x = APCG(sample_state);
+
+	if (!x) {
+		x = (uint32_t) APCG(counter_slot) | 1;
+	}
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	APCG(sample_state) = x;
+
+	return x;
+} /* }}} */
+
+/* {{{ apc_cache_sample_hit
+ Returns whether this hit is one of the 1 in hits_sample hits which are counted */
+static inline zend_bool apc_cache_sample_hit(apc_cache_t *cache) {
+	if (cache->hits_sample <= 1) {
+		return 1;
+	}
+
+	return apc_cache_worker_random() % cache->hits_sample == 0;
+} /* }}} */
+
+/* Update stat counters and access time after a lookup
+ Optimistic readers do not exclude each other, so the counters are always updated atomically.
+ The entry is only written when a sampled hit is counted, or when its access time moved
+ by more than the granularity, so that lookups of hot keys mostly leave it untouched */
+static inline void apc_cache_lookup_stat(
+		apc_cache_t *cache, zend_string *key, apc_cache_entry_t *entry, time_t t) {
+	apc_cache_entry_cold_t *cold;
+	uint32_t atime;
+
+	if (cache->sketch) {
+		apc_cache_sketch_record(cache, ZSTR_HASH(key));
+	}
+
+	if (cache->count_lookups) {
+		apc_cache_counters_t *counters = apc_cache_worker_counters(cache);
+
+		if (entry) {
+			ATOMIC_INC(counters->nhits);
+		} else {
+			ATOMIC_INC(counters->nmisses);
+		}
+	}
+
+	if (!entry) {
+		return;
+	}
 
-			/*
-			 * This is a bit nasty. The idea here is to do runtime cleanup of the linked list of
-			 * entry entries so we don't always have to skip past a bunch of stale entries.
-			 */
-			if (apc_cache_entry_expired(cache, *entry, t)) {
-				apc_cache_wlocked_remove_entry(cache, entry);
-				continue;
-			}
+	cold = APC_CACHE_ENTRY_COLD(entry);
 
-			/* set next entry */
-			entry = &(*entry)->next;
-		}
+	if (cache->eviction == APC_CACHE_EVICT_CLOCK && !cold->referenced) {
+		cold->referenced = 1;
+	}
 
-		/* link in new entry */
-		new_entry->next = *entry;
-		*entry = new_entry;
+	if (apc_cache_sample_hit(cache)) {
+		/* a counted hit stands for every hit of the sample */
+		ATOMIC_ADD(cold->nhits, cache->hits_sample > 1 ? cache->hits_sample : 1);
+	}
 
-		/* set value size from pool size */
-		new_entry->mem_size = apc_pool_size(new_entry->pool);
-		cache->header->mem_size += new_entry->mem_size;
-		cache->header->nentries++;
-		cache->header->ninserts++;
+	atime = APC_CACHE_REL_TIME(cache, t);
+	if (atime > cold->atime && (zend_long) (atime - cold->atime) > cache->atime_granularity) {
+		cold->atime = atime;
 	}
 
-	return 1;
+	/* the ttl of a sliding entry starts over with every hit, at most once a second, the
+	 * timing wheel links entries again when they turn out to expire later than linked.
+	 * Readers race each other and apc_cache_touch, the start only ever moves forward */
+	if ((cold->flags & APC_CACHE_ENTRY_SLIDING) && entry->ttl) {
+		uint32_t slide = cold->slide;
+
+		if (slide < atime && !apc_cache_entry_hard_expired(cache, entry, t)) {
+			ATOMIC_CAS32(cold->slide, slide, atime);
+		}
+	}
 }
 
-static zend_bool apc_cache_make_copy_in_context(
-		apc_cache_t* cache, apc_context_t* context, apc_pool_type pool_type);
-static zend_bool apc_cache_destroy_context(apc_context_t *context);
-static apc_cache_entry_t *apc_cache_make_entry(
-		apc_context_t *ctxt, zend_string *key, const zval* val, const int32_t ttl, time_t t);
+/* Find entry, updating stat counters and access time */
+static inline apc_cache_entry_t *apc_cache_rlocked_find(
+		apc_cache_t *cache, zend_string *key, time_t t) {
+	apc_cache_entry_t *entry = apc_cache_rlocked_find_nostat(cache, key, t);
 
-/* TODO This function may lead to a deadlock on expunge */
-static inline zend_bool apc_cache_store_internal(
-		apc_cache_t *cache, zend_string *key, const zval *val,
-		const int32_t ttl, const zend_bool exclusive) {
+	apc_cache_lookup_stat(cache, key, entry, t);
+	return entry;
+}
+
+/* {{{ apc_cache_optimistic_find
+ Find entry without taking the shard lock, validating the walk against the sequence
+ of the shard. The caller must be in a read section, so that nothing walked over can
+ be freed. Returns 0 when the walk raced a writer, the caller must then repeat the
+ lookup under the shard lock. See apc_cache_rlocked_find_stale for stale. */
+static inline zend_bool apc_cache_optimistic_find(
+		apc_cache_t *cache, apc_cache_shard_t *shard, zend_string *key, time_t t,
+		zend_bool *stale, apc_cache_entry_t **found) {
 	apc_cache_entry_t *entry;
-	time_t t = apc_time();
-	apc_context_t ctxt={0,};
+	zend_ulong seq = shard->seq;
 
-	if (apc_cache_defense(cache, key, t)) {
+	if (seq & 1) {
+		/* a writer is busy in this shard */
 		return 0;
 	}
 
-	/* initialize a context suitable for making an insert */
-	if (!apc_cache_make_copy_in_context(cache, &ctxt, APC_SMALL_POOL)) {
-		return 0;
-	}
+	APC_MEMORY_BARRIER();
 
-	/* initialize the entry for insertion */
-	entry = apc_cache_make_entry(&ctxt, key, val, ttl, t);
-	if (!entry) {
-		apc_cache_destroy_context(&ctxt);
-		return 0;
-	}
+	entry = apc_cache_rlocked_find_stale(cache, key, t, stale);
 
-	/* execute an insertion */
-	if (!apc_cache_wlocked_insert(cache, entry, exclusive)) {
-		apc_cache_destroy_context(&ctxt);
+	APC_MEMORY_BARRIER();
+
+	if (shard->seq != seq) {
 		return 0;
 	}
 
+	*found = entry;
 	return 1;
-}
+} /* }}} */
 
-/* Find entry, without updating stat counters or access time */
-static inline apc_cache_entry_t *apc_cache_rlocked_find_nostat(
-		apc_cache_t *cache, zend_string *key, time_t t) {
+/* {{{ apc_cache_section_find
+ Find entry from a read section, without the shard lock unless we race a writer, or with the
+ shard lock taken by apc_cache_read_enter when locked is set. The entry stays valid until
+ apc_cache_read_leave. See apc_cache_rlocked_find_stale for stale */
+static inline apc_cache_entry_t *apc_cache_section_find(
+		apc_cache_t *cache, zend_string *key, time_t t, zend_bool *stale, apc_cache_shard_t *locked) {
+	apc_cache_shard_t *shard = apc_cache_key_shard(cache, key);
 	apc_cache_entry_t *entry;
-	zend_ulong h, s;
 
-	/* calculate hash and slot */
-	apc_cache_hash_slot(cache, key, &h, &s);
+	if (locked) {
+		entry = apc_cache_rlocked_find_stale(cache, key, t, stale);
+		apc_cache_lookup_stat(cache, key, entry, t);
+		return entry;
+	}
 
-	entry = cache->slots[s];
-	while (entry) {
-		/* check for a matching key by has and identifier */
-		if (h == ZSTR_HASH(entry->key) &&
-			ZSTR_LEN(entry->key) == ZSTR_LEN(key) &&
-			memcmp(ZSTR_VAL(entry->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0) {
+	if (cache->optimistic_reads &&
+		apc_cache_optimistic_find(cache, shard, key, t, stale, &entry)) {
+		apc_cache_lookup_stat(cache, key, entry, t);
+		return entry;
+	}
 
-			/* Check to make sure this entry isn't expired by a hard TTL */
-			if (apc_cache_entry_hard_expired(entry, t)) {
-				break;
-			}
+	APC_RLOCK(shard);
+	entry = apc_cache_rlocked_find_stale(cache, key, t, stale);
+	apc_cache_lookup_stat(cache, key, entry, t);
+	APC_RUNLOCK(shard);
 
-			return entry;
-		}
+	return entry;
+} /* }}} */
 
-		entry = entry->next;
+/* {{{ apc_cache_admit
+ Records the key with the sketch, and decides whether the key may be stored. Keys are
+ always admitted while memory is not running out, or when they replace an existing entry.
+ Otherwise a new key must be more frequent than the entries under the clock hand, which
+ are the entries eviction would consider first to make room for it */
+static zend_bool apc_cache_admit(apc_cache_t *cache, zend_string *key, time_t t) {
+	zend_ulong h = ZSTR_HASH(key);
+	uint32_t frequency, victim = UCHAR_MAX + 1;
+	apc_cache_shard_t *shard;
+	zend_long slot, i;
+
+	apc_cache_sketch_record(cache, h);
+	apc_cache_sketch_age(cache);
+
+	if (cache->sma->get_avail_mem() >= (cache->sma->size * cache->sma->num) / APC_CACHE_ADMISSION_FREE) {
+		return 1;
 	}
 
-	return NULL;
-}
+	if (apc_cache_exists(cache, key, t)) {
+		return 1;
+	}
 
-/* Find entry, updating stat counters and access time */
-static inline apc_cache_entry_t *apc_cache_rlocked_find(
-		apc_cache_t *cache, zend_string *key, time_t t) {
-	apc_cache_entry_t *entry;
-	zend_ulong h, s;
+	frequency = apc_cache_sketch_estimate(cache, h);
 
-	/* calculate hash and slot */
-	apc_cache_hash_slot(cache, key, &h, &s);
+	/* sample the entries of a few slots under the clock hand, the hand may move meanwhile */
+	shard = APC_CACHE_SHARD(cache, cache->header->clock_shard % cache->nshards);
+	slot = cache->header->clock_slot;
 
-	entry = cache->slots[s];
-	while (entry) {
-		/* check for a matching key by has and identifier */
-		if (h == ZSTR_HASH(entry->key) &&
-			ZSTR_LEN(entry->key) == ZSTR_LEN(key) &&
-			memcmp(ZSTR_VAL(entry->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0) {
+	APC_RLOCK(shard);
+	for (i = 0; i < APC_CACHE_ADMISSION_SAMPLE; i++) {
+		apc_cache_entry_t *entry =
+			APC_CACHE_SHARD_BUCKET(shard, (slot + i) % APC_CACHE_SHARD_NSLOTS(shard))->head;
 
-			/* Check to make sure this entry isn't expired by a hard TTL */
-			if (apc_cache_entry_hard_expired(entry, t)) {
-				break;
+		while (entry) {
+			uint32_t estimate = apc_cache_sketch_estimate(cache, ZSTR_HASH(&entry->key));
+			if (estimate < victim) {
+				victim = estimate;
 			}
-
-			ATOMIC_INC_RLOCKED(cache->header->nhits);
-			ATOMIC_INC_RLOCKED(entry->nhits);
-			entry->atime = t;
-
-			return entry;
+			entry = entry->next;
 		}
-
-		entry = entry->next;
 	}
+	APC_RUNLOCK(shard);
 
-	ATOMIC_INC_RLOCKED(cache->header->nmisses);
-	return NULL;
-}
-
-static inline apc_cache_entry_t *apc_cache_rlocked_find_incref(
-		apc_cache_t *cache, zend_string *key, time_t t) {
-	apc_cache_entry_t *entry = apc_cache_rlocked_find(cache, key, t);
-	if (!entry) {
-		return NULL;
+	/* nothing to compare with */
+	if (victim > UCHAR_MAX) {
+		return 1;
 	}
 
-	ATOMIC_INC_RLOCKED(entry->ref_count);
-	return entry;
-}
+	return frequency > victim;
+} /* }}} */
 
 /* {{{ apc_cache_store */
 PHP_APCU_API zend_bool apc_cache_store(
 		apc_cache_t* cache, zend_string *key, const zval *val,
 		const int32_t ttl, const zend_bool exclusive) {
+	return apc_cache_store_ex(cache, key, val, ttl, exclusive, 0, cache->ttl_jitter);
+} /* }}} */
+
+/* {{{ apc_cache_store_ex */
+PHP_APCU_API zend_bool apc_cache_store_ex(
+		apc_cache_t* cache, zend_string *key, const zval *val,
+		const int32_t ttl, const zend_bool exclusive, const uint32_t flags, const zend_long jitter) {
+	apc_cache_shard_t *shard;
 	apc_cache_entry_t *entry;
 	time_t t = apc_time();
 	apc_context_t ctxt={0,};
@@ -510,35 +1817,93 @@ PHP_APCU_API zend_bool apc_cache_store(
 		return 0;
 	}
 
+	/* run admission filter, before any memory is allocated for the entry */
+	if (cache->sketch && !apc_cache_admit(cache, key, t)) {
+		return 0;
+	}
+
 	/* initialize a context suitable for making an insert */
 	if (!apc_cache_make_copy_in_context(cache, &ctxt, APC_SMALL_POOL)) {
 		return 0;
 	}
 
 	/* initialize the entry for insertion */
-	entry = apc_cache_make_entry(&ctxt, key, val, ttl, t);
+	entry = apc_cache_make_entry(cache, &ctxt, key, val, ttl, jitter, t);
 	if (!entry) {
 		apc_cache_destroy_context(&ctxt);
 		return 0;
 	}
 
+	APC_CACHE_ENTRY_COLD(entry)->flags = flags;
+
 	/* execute an insertion */
-	if (!APC_WLOCK(cache->header)) {
+	shard = apc_cache_key_shard(cache, key);
+	if (!APC_WLOCK(shard)) {
 		apc_cache_destroy_context(&ctxt);
 		return 0;
 	}
 
 	php_apc_try {
-		ret = apc_cache_wlocked_insert(cache, entry, exclusive);
+		ret = apc_cache_wlocked_insert(cache, entry, t, exclusive);
 	} php_apc_finally {
-		APC_WUNLOCK(cache->header);
+		APC_WUNLOCK(shard);
 	} php_apc_end_try();
 
 	/* destroy context if insertion failed */
 	if (!ret) {
 		apc_cache_destroy_context(&ctxt);
+		return 0;
+	}
+
+	/* grow the table of the shard when it became too crowded */
+	apc_cache_grow(cache, shard);
+
+	return ret;
+} /* }}} */
+
+/* {{{ apc_cache_store_missing */
+PHP_APCU_API zend_bool apc_cache_store_missing(
+		apc_cache_t* cache, zend_string *key, const int32_t ttl) {
+	apc_cache_shard_t *shard;
+	apc_cache_entry_t *entry;
+	void *mem;
+	time_t t = apc_time();
+	zend_bool ret = 0;
+
+	/* run cache defense */
+	if (apc_cache_defense(cache, key, t)) {
+		return 0;
+	}
+
+	/* the entry is allocated on its own, there is no value to pool with it */
+	mem = cache->sma->smalloc(APC_CACHE_ENTRY_SIZE(ZSTR_LEN(key)));
+	if (!mem) {
+		return 0;
+	}
+
+	entry = apc_cache_init_entry(cache, mem, key, ttl, t);
+
+	/* execute an insertion */
+	shard = apc_cache_key_shard(cache, key);
+	if (!APC_WLOCK(shard)) {
+		cache->sma->sfree(mem);
+		return 0;
+	}
+
+	php_apc_try {
+		ret = apc_cache_wlocked_insert(cache, entry, t, 0);
+	} php_apc_finally {
+		APC_WUNLOCK(shard);
+	} php_apc_end_try();
+
+	if (!ret) {
+		cache->sma->sfree(mem);
+		return 0;
 	}
 
+	/* grow the table of the shard when it became too crowded */
+	apc_cache_grow(cache, shard);
+
 	return ret;
 } /* }}} */
 
@@ -665,7 +2030,18 @@ PHP_APCU_API zend_bool apc_cache_preload(apc_cache_t* cache, const char *path)
 /* {{{ apc_cache_entry_release */
 PHP_APCU_API void apc_cache_entry_release(apc_cache_t *cache, apc_cache_entry_t *entry)
 {
-	ATOMIC_DEC(entry->ref_count);
+	int i = APCG(nholds);
+
+	/* entries are mostly released in the reverse order they were found */
+	while (i-- > 0) {
+		apc_cache_hold_t *hold = &APCG(holds)[i];
+
+		if (hold->cache == cache && hold->entry == entry) {
+			apc_cache_epoch_leave(cache, hold->reader);
+			*hold = APCG(holds)[--APCG(nholds)];
+			return;
+		}
+	}
 }
 /* }}} */
 
@@ -676,7 +2052,14 @@ PHP_APCU_API void apc_cache_destroy(apc_cache_t* cache)
 		return;
 	}
 
-	/* destroy lock */
+	/* destroy locks */
+	{
+		zend_long i;
+
+		for (i = 0; i < cache->nshards; i++) {
+			DESTROY_LOCK(&APC_CACHE_SHARD(cache, i)->lock);
+		}
+	}
 	DESTROY_LOCK(&cache->header->lock);
 
 	/* XXX this is definitely a leak, but freeing this causes all the apache
@@ -687,66 +2070,331 @@ PHP_APCU_API void apc_cache_destroy(apc_cache_t* cache)
 }
 /* }}} */
 
-/* {{{ apc_cache_wlocked_real_expunge */
-static void apc_cache_wlocked_real_expunge(apc_cache_t* cache) {
+/* {{{ apc_cache_slam_reset
+ Forgets the inserts slam defense remembers */
+static inline void apc_cache_slam_reset(apc_cache_t* cache) {
+	if (cache->slam_keys) {
+		memset(cache->slam_keys, 0, (cache->slam_mask + 1) * sizeof(apc_cache_slam_key_t));
+	}
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_reset_info */
+static void apc_cache_wlocked_reset_info(apc_cache_t* cache) {
+	zend_long i;
+
+	/* set new time so counters make sense */
+	cache->header->stime = apc_time();
+
+	/* reset counters, the readers of the counter shards are still reading */
+	cache->header->ninserts = 0;
+	for (i = 0; i < APC_CACHE_COUNTERS; i++) {
+		cache->counters[i].nhits = 0;
+		cache->counters[i].nmisses = 0;
+	}
+
+	/* resets slam defense */
+	apc_cache_slam_reset(cache);
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_real_expunge
+ Removes every entry, pinned entries only when pinned is set */
+static void apc_cache_wlocked_real_expunge(apc_cache_t* cache, zend_bool pinned) {
 	/* increment counter */
 	cache->header->nexpunges++;
 
 	/* expunge */
 	{
-		zend_ulong i;
+		zend_long i, j;
+
+		for (i = 0; i < cache->nshards; i++) {
+			apc_cache_shard_t *shard = APC_CACHE_SHARD(cache, i);
+
+			for (j = 0; j < APC_CACHE_SHARD_NSLOTS(shard); j++) {
+				apc_cache_bucket_t *bucket = APC_CACHE_SHARD_BUCKET(shard, j);
+				apc_cache_entry_t **entry = &bucket->head;
+				while (*entry) {
+					if (!pinned && (APC_CACHE_ENTRY_COLD(*entry)->flags & APC_CACHE_ENTRY_PINNED)) {
+						entry = &(*entry)->next;
+						continue;
+					}
 
-		for (i = 0; i < cache->nslots; i++) {
-			apc_cache_entry_t **entry = &cache->slots[i];
-			while (*entry) {
-				apc_cache_wlocked_remove_entry(cache, entry);
+					apc_cache_wlocked_remove_entry(cache, shard, bucket, entry);
+				}
 			}
 		}
 	}
 
-	/* set new time so counters make sense */
+	apc_cache_wlocked_reset_info(cache);
+} /* }}} */
+
+/* {{{ apc_cache_wlocked_swap_tables
+ Swaps fresh tables in for the tables of every shard, starting a new generation of the
+ cache. The old tables are queued up with their entries, see apc_cache_reclaim_cleared */
+static zend_bool apc_cache_wlocked_swap_tables(apc_cache_t* cache, apc_cache_table_t **tables) {
+	apc_cache_header_t *header = cache->header;
+	apc_cache_table_t **cleared;
+	zend_long i;
+
+	if (!APC_WLOCK(header)) {
+		return 0;
+	}
+
+	/* cleared tables are queued in the order they were cleared */
+	cleared = &header->cleared;
+	while (*cleared) {
+		cleared = &(*cleared)->next;
+	}
+
+	for (i = 0; i < cache->nshards; i++) {
+		apc_cache_shard_t *shard = APC_CACHE_SHARD(cache, i);
+		apc_cache_table_t *old[2];
+		int j;
+
+		apc_cache_wlocked_seq_begin(shard);
+		old[0] = shard->table;
+		old[1] = shard->old_table;
+		shard->table = tables[i];
+		shard->old_table = NULL;
+		shard->rehash_idx = 0;
+		shard->nentries = 0;
+
+		/* the entries in the wheel went with the tables */
+		memset(shard->wheel.slots, 0, sizeof(shard->wheel.slots));
+		shard->wheel.nentries = 0;
+		apc_cache_wlocked_seq_end(shard);
+
+		for (j = 0; j < 2; j++) {
+			if (old[j]) {
+				old[j]->next = NULL;
+				old[j]->epoch = header->epoch;
+				*cleared = old[j];
+				cleared = &old[j]->next;
+			}
+		}
+	}
+
+	header->generation++;
+	header->nentries = 0;
+	header->mem_size = 0;
+	header->clock_shard = 0;
+	header->clock_slot = 0;
+	header->sweep_shard = 0;
+	header->sweep_slot = 0;
+
+	APC_WUNLOCK(header);
+
+	return 1;
+} /* }}} */
+
+/* {{{ apc_cache_clear */
+PHP_APCU_API void apc_cache_clear(apc_cache_t* cache)
+{
+	apc_cache_table_t **tables;
+	zend_long nslots, i;
+
+	/* check there is a cache and it is not busy */
+	if (!cache || apc_cache_busy(cache)) {
+		return;
+	}
+
+	/* tables for the new generation are allocated before locking, allocating may expunge */
+	nslots = cache->nslots / cache->nshards;
+	tables = (apc_cache_table_t **) apc_emalloc(cache->nshards * sizeof(apc_cache_table_t *));
+
+	for (i = 0; tables && i < cache->nshards; i++) {
+		tables[i] = cache->sma->smalloc(APC_CACHE_TABLE_SIZE(nslots));
+		if (!tables[i]) {
+			break;
+		}
+
+		memset(tables[i], 0, APC_CACHE_TABLE_SIZE(nslots));
+		tables[i] = apc_cache_table_init(tables[i], nslots, cache->pow2_slots, 1);
+	}
+
+	if (tables && i < cache->nshards) {
+		/* no room for new tables, every entry is removed under the lock instead */
+		while (i-- > 0) {
+			cache->sma->sfree(tables[i]);
+		}
+		apc_efree(tables);
+		tables = NULL;
+	}
+
+	/* lock all shards */
+	if (!apc_cache_wlock_all(cache)) {
+		if (tables) {
+			for (i = 0; i < cache->nshards; i++) {
+				cache->sma->sfree(tables[i]);
+			}
+			apc_efree(tables);
+		}
+		return;
+	}
+
+	if (tables) {
+		/* reads and writes go on in the new tables right away */
+		zend_bool swapped = apc_cache_wlocked_swap_tables(cache, tables);
+
+		if (swapped) {
+			apc_cache_wlocked_reset_info(cache);
+			cache->header->nexpunges = 0;
+		} else {
+			for (i = 0; i < cache->nshards; i++) {
+				cache->sma->sfree(tables[i]);
+			}
+		}
+		apc_efree(tables);
+
+		apc_cache_wunlock_all(cache);
+		return;
+	}
+
+	/* set busy */
+	cache->header->state |= APC_CACHE_ST_BUSY;
+
+	/* expunge cache, pinned entries included */
+	apc_cache_wlocked_real_expunge(cache, 1);
+	apc_cache_gc(cache);
+
+	/* set info */
 	cache->header->stime = apc_time();
+	cache->header->nexpunges = 0;
 
-	/* reset counters */
-	cache->header->ninserts = 0;
-	cache->header->nentries = 0;
-	cache->header->nhits = 0;
-	cache->header->nmisses = 0;
+	/* unset busy */
+	cache->header->state &= ~APC_CACHE_ST_BUSY;
+
+	/* unlock all shards */
+	apc_cache_wunlock_all(cache);
+}
+/* }}} */
+
+/* {{{ apc_cache_wlocked_clock_evict
+ Moves the clock hand over the slots of every shard, removing entries that are expired
+ or were not hit since the hand last passed them, and clearing the reference of the rest.
+ Stops once the removed entries used at least size bytes, or after two turns */
+static void apc_cache_wlocked_clock_evict(apc_cache_t* cache, size_t size, time_t t)
+{
+	apc_cache_header_t *header = cache->header;
+	size_t reclaimed = 0;
+	zend_long nslots = 0, visited = 0, i;
+
+	for (i = 0; i < cache->nshards; i++) {
+		nslots += APC_CACHE_SHARD_NSLOTS(APC_CACHE_SHARD(cache, i));
+	}
+
+	while (reclaimed < size && visited < 2 * nslots) {
+		apc_cache_shard_t *shard;
+		apc_cache_bucket_t *bucket;
+		apc_cache_entry_t **entry;
+
+		if (header->clock_shard >= cache->nshards) {
+			header->clock_shard = 0;
+		}
+
+		shard = APC_CACHE_SHARD(cache, header->clock_shard);
+		if (header->clock_slot >= APC_CACHE_SHARD_NSLOTS(shard)) {
+			/* move on to the next shard */
+			header->clock_slot = 0;
+			header->clock_shard++;
+			continue;
+		}
+
+		bucket = APC_CACHE_SHARD_BUCKET(shard, header->clock_slot);
+		entry = &bucket->head;
+		while (*entry) {
+			apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(*entry);
+
+			if ((!cold->referenced && !(cold->flags & APC_CACHE_ENTRY_PINNED))
+				|| apc_cache_entry_expired(cache, *entry, t)) {
+				reclaimed += cold->mem_size;
+				apc_cache_wlocked_remove_entry(cache, shard, bucket, entry);
+				continue;
+			}
+
+			/* second chance */
+			cold->referenced = 0;
+			entry = &(*entry)->next;
+		}
+
+		header->clock_slot++;
+		visited++;
+	}
+} /* }}} */
+
+/* {{{ apc_cache_sweep */
+PHP_APCU_API void apc_cache_sweep(apc_cache_t* cache)
+{
+	apc_cache_shard_t *shard;
+	zend_long idx, first, last, i;
+	time_t t = apc_time();
+
+	if (!cache || apc_cache_busy(cache)) {
+		return;
+	}
+
+	/* entries of cleared generations are reclaimed here, even when sweeping is disabled */
+	apc_cache_reclaim_cleared(cache, APC_CACHE_RECLAIM_STEP);
+
+	if (!cache->sweep_slots) {
+		return;
+	}
+
+	if (cache->sweep_interval && t - cache->header->sweep_time < cache->sweep_interval) {
+		return;
+	}
 
-	/* resets lastkey */
-	memset(&cache->header->lastkey, 0, sizeof(apc_cache_slam_key_t));
-} /* }}} */
+	idx = cache->header->sweep_shard % cache->nshards;
+	shard = APC_CACHE_SHARD(cache, idx);
 
-/* {{{ apc_cache_clear */
-PHP_APCU_API void apc_cache_clear(apc_cache_t* cache)
-{
-	/* check there is a cache and it is not busy */
-	if (!cache || apc_cache_busy(cache)) {
+	if (!APC_WLOCK(shard)) {
 		return;
 	}
 
-	/* lock header */
+	/* claim the slots to sweep, the shard lock is taken before the header lock */
 	if (!APC_WLOCK(cache->header)) {
+		APC_WUNLOCK(shard);
 		return;
 	}
 
-	/* set busy */
-	cache->header->state |= APC_CACHE_ST_BUSY;
-
-	/* expunge cache */
-	apc_cache_wlocked_real_expunge(cache);
+	if (cache->header->sweep_shard % cache->nshards != idx) {
+		/* another process moved the cursor to another shard meanwhile */
+		APC_WUNLOCK(cache->header);
+		APC_WUNLOCK(shard);
+		return;
+	}
 
-	/* set info */
-	cache->header->stime = apc_time();
-	cache->header->nexpunges = 0;
+	first = cache->header->sweep_slot;
+	last = first + cache->sweep_slots;
 
-	/* unset busy */
-	cache->header->state &= ~APC_CACHE_ST_BUSY;
+	if (last >= APC_CACHE_SHARD_NSLOTS(shard)) {
+		last = APC_CACHE_SHARD_NSLOTS(shard);
+		cache->header->sweep_shard = (idx + 1) % cache->nshards;
+		cache->header->sweep_slot = 0;
+	} else {
+		cache->header->sweep_slot = last;
+	}
+	cache->header->sweep_time = t;
 
-	/* unlock header */
 	APC_WUNLOCK(cache->header);
-}
-/* }}} */
+
+	/* entries with a ttl expire through the wheel, the walk finds entries soft expired by apc.ttl */
+	apc_cache_wlocked_wheel_advance(cache, shard, t);
+
+	for (i = first; i < last; i++) {
+		apc_cache_bucket_t *bucket = APC_CACHE_SHARD_BUCKET(shard, i);
+		apc_cache_entry_t **entry = &bucket->head;
+
+		while (*entry) {
+			if (apc_cache_entry_expired(cache, *entry, t)) {
+				apc_cache_wlocked_remove_entry(cache, shard, bucket, entry);
+				continue;
+			}
+			entry = &(*entry)->next;
+		}
+	}
+
+	APC_WUNLOCK(shard);
+} /* }}} */
 
 /* {{{ apc_cache_default_expunge */
 PHP_APCU_API void apc_cache_default_expunge(apc_cache_t* cache, size_t size)
@@ -761,8 +2409,8 @@ PHP_APCU_API void apc_cache_default_expunge(apc_cache_t* cache, size_t size)
 		return;
 	}
 
-	/* get the lock for header */
-	if (!APC_WLOCK(cache->header)) {
+	/* get the lock for all shards */
+	if (!apc_cache_wlock_all(cache)) {
 		return;
 	}
 
@@ -772,53 +2420,90 @@ PHP_APCU_API void apc_cache_default_expunge(apc_cache_t* cache, size_t size)
 	/* make suitable selection */
 	suitable = (cache->smart > 0L) ? (size_t) (cache->smart * size) : (size_t) (cache->sma->size/2);
 
-	/* gc */
-	apc_cache_wlocked_gc(cache);
+	/* gc, entries of cleared generations go first */
+	{
+		zend_long i;
+
+		for (i = 0; i < cache->nshards; i++) {
+			apc_cache_wlocked_gc_flush(cache, APC_CACHE_SHARD(cache, i));
+		}
+	}
+	apc_cache_gc(cache);
+	apc_cache_reclaim_cleared(cache, 0);
+
+	/* remove the entries which expired, without walking the slots */
+	{
+		zend_long i;
+
+		for (i = 0; i < cache->nshards; i++) {
+			apc_cache_wlocked_wheel_advance(cache, APC_CACHE_SHARD(cache, i), t);
+		}
+	}
 
 	/* get available */
 	available = cache->sma->get_avail_mem();
 
 	/* perform expunge processing */
-	if (!cache->ttl) {
+	if (cache->eviction == APC_CACHE_EVICT_CLOCK) {
+		/* another process may have made room already */
+		if (!cache->sma->get_avail_size(size)) {
+			apc_cache_wlocked_clock_evict(
+				cache, (cache->smart > 0L) ? (size_t) (cache->smart * size) : size, t);
+
+			/* wipe slam defense */
+			apc_cache_slam_reset(cache);
+		}
+	} else if (!cache->ttl) {
 		/* check it is necessary to expunge */
 		if (available < suitable) {
-			apc_cache_wlocked_real_expunge(cache);
+			apc_cache_wlocked_real_expunge(cache, 0);
 		}
 	} else {
 		/* check that expunge is necessary */
 		if (available < suitable) {
-			zend_ulong i;
+			zend_long i, j;
 
 			/* look for junk */
-			for (i = 0; i < cache->nslots; i++) {
-				apc_cache_entry_t **entry = &cache->slots[i];
-				while (*entry) {
-					if (apc_cache_entry_expired(cache, *entry, t)) {
-						apc_cache_wlocked_remove_entry(cache, entry);
-						continue;
-					}
+			for (i = 0; i < cache->nshards; i++) {
+				apc_cache_shard_t *shard = APC_CACHE_SHARD(cache, i);
+
+				for (j = 0; j < APC_CACHE_SHARD_NSLOTS(shard); j++) {
+					apc_cache_bucket_t *bucket = APC_CACHE_SHARD_BUCKET(shard, j);
+					apc_cache_entry_t **entry = &bucket->head;
+					while (*entry) {
+						if (apc_cache_entry_expired(cache, *entry, t)) {
+							apc_cache_wlocked_remove_entry(cache, shard, bucket, entry);
+							continue;
+						}
 
-					/* grab next entry */
-					entry = &(*entry)->next;
+						/* grab next entry */
+						entry = &(*entry)->next;
+					}
 				}
 			}
 
-			/* if the cache now has space, then reset last key */
+			/* the junk is only on the gc list, free it before looking for space */
+			apc_cache_gc(cache);
+
+			/* if the cache now has space, then reset slam defense */
 			if (cache->sma->get_avail_size(size)) {
-				/* wipe lastkey */
-				memset(&cache->header->lastkey, 0, sizeof(apc_cache_slam_key_t));
+				/* wipe slam defense */
+				apc_cache_slam_reset(cache);
 			} else {
 				/* with not enough space left in cache, we are forced to expunge */
-				apc_cache_wlocked_real_expunge(cache);
+				apc_cache_wlocked_real_expunge(cache, 0);
 			}
 		}
 	}
 
+	/* free what was removed, unless readers still hold it */
+	apc_cache_gc(cache);
+
 	/* we are done */
 	cache->header->state &= ~APC_CACHE_ST_BUSY;
 
-	/* unlock header */
-	APC_WUNLOCK(cache->header);
+	/* unlock all shards */
+	apc_cache_wunlock_all(cache);
 }
 /* }}} */
 
@@ -857,15 +2542,37 @@ static zend_bool apc_cache_destroy_context(apc_context_t *context) {
 PHP_APCU_API apc_cache_entry_t* apc_cache_find(apc_cache_t* cache, zend_string *key, time_t t)
 {
 	apc_cache_entry_t *entry;
+	apc_cache_reader_t *reader;
+	apc_cache_hold_t *hold;
 
 	/* check we are able to deal with the request */
 	if (!cache || apc_cache_busy(cache)) {
 		return NULL;
 	}
 
-	APC_RLOCK(cache->header);
-	entry = apc_cache_rlocked_find_incref(cache, key, t);
-	APC_RUNLOCK(cache->header);
+	if (APCG(nholds) == APC_CACHE_HOLDS) {
+		apc_warning("apc_cache_find: more than %d entries cannot be held at once", APC_CACHE_HOLDS);
+		return NULL;
+	}
+
+	/* the entry is returned, the lock of its shard cannot stand in for a section */
+	reader = apc_cache_epoch_enter(cache);
+	if (!reader) {
+		apc_warning("apc_cache_find: every read section is taken, apc.reader_slots is too low");
+		return NULL;
+	}
+
+	entry = apc_cache_section_find(cache, key, t, NULL, NULL);
+	if (!entry) {
+		apc_cache_epoch_leave(cache, reader);
+		return NULL;
+	}
+
+	/* the section is kept open in globals until the entry is released */
+	hold = &APCG(holds)[APCG(nholds)++];
+	hold->cache = cache;
+	hold->entry = entry;
+	hold->reader = reader;
 
 	return entry;
 }
@@ -873,27 +2580,42 @@ PHP_APCU_API apc_cache_entry_t* apc_cache_find(apc_cache_t* cache, zend_string *
 
 /* {{{ apc_cache_fetch */
 PHP_APCU_API zend_bool apc_cache_fetch(apc_cache_t* cache, zend_string *key, time_t t, zval **dst)
+{
+	return apc_cache_fetch_ex(cache, key, t, dst, NULL);
+} /* }}} */
+
+/* {{{ apc_cache_fetch_ex */
+PHP_APCU_API zend_bool apc_cache_fetch_ex(apc_cache_t* cache, zend_string *key, time_t t, zval **dst, zend_bool *missing)
 {
 	apc_cache_entry_t *entry;
 	zend_bool retval = 0;
+	apc_cache_reader_t *reader;
+	apc_cache_shard_t *locked;
+
+	if (missing) {
+		*missing = 0;
+	}
 
 	/* check we are able to deal with the request */
 	if (!cache || apc_cache_busy(cache)) {
 		return 0;
 	}
 
-	APC_RLOCK(cache->header);
-	entry = apc_cache_rlocked_find_incref(cache, key, t);
-	APC_RUNLOCK(cache->header);
-
-	if (!entry) {
-		return 0;
-	}
+	reader = apc_cache_read_enter(cache, key, &locked);
 
 	php_apc_try {
-		retval = apc_cache_entry_fetch_zval(cache, entry, *dst);
+		entry = apc_cache_section_find(cache, key, t, NULL, locked);
+		if (entry) {
+			if (APC_CACHE_ENTRY_MISSING(entry)) {
+				if (missing) {
+					*missing = 1;
+				}
+			} else {
+				retval = apc_cache_entry_fetch_zval(cache, entry, *dst);
+			}
+		}
 	} php_apc_finally {
-		apc_cache_entry_release(cache, entry);
+		apc_cache_read_leave(cache, reader, locked);
 	} php_apc_end_try();
 
 	return retval;
@@ -902,6 +2624,7 @@ PHP_APCU_API zend_bool apc_cache_fetch(apc_cache_t* cache, zend_string *key, tim
 /* {{{ apc_cache_exists */
 PHP_APCU_API zend_bool apc_cache_exists(apc_cache_t* cache, zend_string *key, time_t t)
 {
+	apc_cache_shard_t *shard;
 	apc_cache_entry_t *entry;
 
 	if (apc_cache_busy(cache)) {
@@ -909,11 +2632,69 @@ PHP_APCU_API zend_bool apc_cache_exists(apc_cache_t* cache, zend_string *key, ti
 		return 0;
 	}
 
-	APC_RLOCK(cache->header);
+	shard = apc_cache_key_shard(cache, key);
+	if (cache->optimistic_reads) {
+		apc_cache_reader_t *reader = apc_cache_epoch_enter(cache);
+
+		/* without a section left, the lookup is done under the lock */
+		if (reader) {
+			zend_bool found = apc_cache_optimistic_find(cache, shard, key, t, NULL, &entry);
+
+			apc_cache_epoch_leave(cache, reader);
+			if (found) {
+				return entry != NULL && !APC_CACHE_ENTRY_MISSING(entry);
+			}
+		}
+	}
+
+	APC_RLOCK(shard);
 	entry = apc_cache_rlocked_find_nostat(cache, key, t);
-	APC_RUNLOCK(cache->header);
+	APC_RUNLOCK(shard);
+
+	return entry != NULL && !APC_CACHE_ENTRY_MISSING(entry);
+}
+/* }}} */
+
+/* {{{ apc_cache_touch */
+PHP_APCU_API zend_bool apc_cache_touch(apc_cache_t *cache, zend_string *key, const int32_t ttl)
+{
+	apc_cache_shard_t *shard;
+	apc_cache_entry_t *entry;
+	zend_bool retval = 0;
+	time_t t = apc_time();
+
+	if (apc_cache_busy(cache)) {
+		/* cannot service request right now */
+		return 0;
+	}
 
-	return entry != NULL;
+	shard = apc_cache_key_shard(cache, key);
+	if (!APC_WLOCK(shard)) {
+		return 0;
+	}
+
+	php_apc_try {
+		entry = apc_cache_rlocked_find_nostat(cache, key, t);
+		if (entry && !APC_CACHE_ENTRY_MISSING(entry)) {
+			/* optimistic readers must not see the new ttl with the old creation time */
+			apc_cache_wlocked_seq_begin(shard);
+			entry->ctime = APC_CACHE_REL_TIME(cache, t);
+			entry->ttl = ttl;
+			APC_CACHE_ENTRY_COLD(entry)->slide = entry->ctime;
+			apc_cache_wlocked_seq_end(shard);
+
+			/* the wheel would only notice a later expiry, the entry is linked again */
+			apc_cache_wlocked_wheel_unlink(shard, entry);
+			if (ttl) {
+				apc_cache_wlocked_wheel_link(shard, entry);
+			}
+			retval = 1;
+		}
+	} php_apc_finally {
+		APC_WUNLOCK(shard);
+	} php_apc_end_try();
+
+	return retval;
 }
 /* }}} */
 
@@ -922,10 +2703,11 @@ PHP_APCU_API zend_bool apc_cache_update(
 		apc_cache_t *cache, zend_string *key, apc_cache_updater_t updater, void *data,
 		zend_bool insert_if_not_found, zend_long ttl)
 {
+	apc_cache_shard_t *shard;
 	apc_cache_entry_t **entry;
 
 	zend_bool retval = 0;
-	zend_ulong h, s;
+	zend_ulong h;
 	time_t t = apc_time();
 
 	if (apc_cache_busy(cache)) {
@@ -934,23 +2716,24 @@ PHP_APCU_API zend_bool apc_cache_update(
 	}
 
 	/* calculate hash */
-	apc_cache_hash_slot(cache, key, &h, &s);
+	apc_cache_hash_shard(cache, key, &h, &shard);
 
 retry_update:
-	if (!APC_WLOCK(cache->header)) {
+	if (!APC_WLOCK(shard)) {
 		return 0;
 	}
 
 	php_apc_try {
 		/* find head */
-		entry = &cache->slots[s];
+		entry = &apc_cache_wlocked_bucket(cache, shard, h)->head;
 
 		while (*entry) {
 			/* check for a match by hash and identifier */
-			if (h == ZSTR_HASH((*entry)->key) &&
-				ZSTR_LEN((*entry)->key) == ZSTR_LEN(key) &&
-				memcmp(ZSTR_VAL((*entry)->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0 &&
-				!apc_cache_entry_hard_expired(*entry, t)
+			if (h == ZSTR_HASH(&(*entry)->key) &&
+				ZSTR_LEN(&(*entry)->key) == ZSTR_LEN(key) &&
+				memcmp(ZSTR_VAL(&(*entry)->key), ZSTR_VAL(key), ZSTR_LEN(key)) == 0 &&
+				!apc_cache_entry_hard_expired(cache, *entry, t) &&
+				!APC_CACHE_ENTRY_MISSING(*entry)
 			) {
 				/* attempt to perform update */
 				switch (Z_TYPE((*entry)->val)) {
@@ -963,14 +2746,16 @@ retry_update:
 						/* break intentionally omitted */
 
 					default:
-						/* executing update */
+						/* executing update, optimistic readers retry while it runs */
+						apc_cache_wlocked_seq_begin(shard);
 						retval = updater(cache, *entry, data);
 						/* set modified time */
-						(*entry)->mtime = t;
+						APC_CACHE_ENTRY_COLD(*entry)->mtime = APC_CACHE_REL_TIME(cache, t);
+						apc_cache_wlocked_seq_end(shard);
 						break;
 				}
 
-				APC_WUNLOCK(cache->header);
+				APC_WUNLOCK(shard);
 				php_apc_try_finish();
 				return retval;
 			}
@@ -979,7 +2764,7 @@ retry_update:
 			entry = &(*entry)->next;
 		}
 	} php_apc_finally {
-		APC_WUNLOCK(cache->header);
+		APC_WUNLOCK(shard);
 	} php_apc_end_try();
 
 	if (insert_if_not_found) {
@@ -1004,43 +2789,46 @@ retry_update:
 /* {{{ apc_cache_delete */
 PHP_APCU_API zend_bool apc_cache_delete(apc_cache_t *cache, zend_string *key)
 {
+	apc_cache_shard_t *shard;
+	apc_cache_bucket_t *bucket;
 	apc_cache_entry_t **entry;
-	zend_ulong h, s;
+	zend_ulong h;
 
 	if (!cache) {
 		return 1;
 	}
 
-	/* calculate hash and slot */
-	apc_cache_hash_slot(cache, key, &h, &s);
+	/* calculate hash and shard */
+	apc_cache_hash_shard(cache, key, &h, &shard);
 
-	/* lock cache */
-	if (!APC_WLOCK(cache->header)) {
+	/* lock shard */
+	if (!APC_WLOCK(shard)) {
 		return 1;
 	}
 
 	/* find head */
-	entry = &cache->slots[s];
+	bucket = apc_cache_wlocked_bucket(cache, shard, h);
+	entry = &bucket->head;
 
 	while (*entry) {
 		/* check for a match by hash and identifier */
-		if (h == ZSTR_HASH((*entry)->key) &&
-			ZSTR_LEN((*entry)->key) == ZSTR_LEN(key) &&
-			memcmp(ZSTR_VAL((*entry)->key), ZSTR_VAL(key), ZSTR_LEN(key)) == SUCCESS) {
+		if (h == ZSTR_HASH(&(*entry)->key) &&
+			ZSTR_LEN(&(*entry)->key) == ZSTR_LEN(key) &&
+			memcmp(ZSTR_VAL(&(*entry)->key), ZSTR_VAL(key), ZSTR_LEN(key)) == SUCCESS) {
 
 			/* executing removal */
-			apc_cache_wlocked_remove_entry(cache, entry);
+			apc_cache_wlocked_remove_entry(cache, shard, bucket, entry);
 
-			/* unlock header */
-			APC_WUNLOCK(cache->header);
+			/* unlock shard */
+			APC_WUNLOCK(shard);
 			return 1;
 		}
 
 		entry = &(*entry)->next;
 	}
 
-	/* unlock header */
-	APC_WUNLOCK(cache->header);
+	/* unlock shard */
+	APC_WUNLOCK(shard);
 	return 0;
 }
 /* }}} */
@@ -1454,6 +3242,12 @@ PHP_APCU_API zend_bool apc_cache_entry_fetch_zval(
 {
 	apc_context_t ctxt = {0, };
 
+	/* entries of missing keys have no value */
+	if (APC_CACHE_ENTRY_MISSING(entry)) {
+		ZVAL_NULL(dst);
+		return 0;
+	}
+
 	/* set context information */
 	ctxt.pool = NULL;
 	ctxt.serializer = cache->serializer;
@@ -1477,38 +3271,103 @@ PHP_APCU_API zend_bool apc_cache_entry_fetch_zval(
 }
 /* }}} */
 
+/* {{{ apc_cache_init_entry
+ Initializes an entry in mem, of APC_CACHE_ENTRY_SIZE bytes, without a value and without a pool */
+static apc_cache_entry_t *apc_cache_init_entry(
+		apc_cache_t *cache, void *mem, zend_string *key,
+		const int32_t ttl, time_t t)
+{
+	/* the entry starts on the first cache line after its cold part, and is followed by the key */
+	apc_cache_entry_t *entry = (apc_cache_entry_t *) ALIGNSIZE(
+		(zend_uintptr_t) mem + sizeof(apc_cache_entry_cold_t), APC_CACHE_LINE_SIZE);
+	apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
+
+#if PHP_VERSION_ID >= 70300
+	GC_SET_REFCOUNT(&entry->key, 1);
+	GC_TYPE_INFO(&entry->key) = IS_STRING | (IS_STR_PERSISTENT << GC_FLAGS_SHIFT);
+#else
+	GC_REFCOUNT(&entry->key) = 1;
+	GC_TYPE_INFO(&entry->key) = IS_STRING;
+	GC_FLAGS(&entry->key) = IS_STR_PERSISTENT;
+#endif
+	ZSTR_H(&entry->key) = ZSTR_HASH(key);
+	ZSTR_LEN(&entry->key) = ZSTR_LEN(key);
+	memcpy(ZSTR_VAL(&entry->key), ZSTR_VAL(key), ZSTR_LEN(key));
+	ZSTR_VAL(&entry->key)[ZSTR_LEN(key)] = '\0';
+
+	ZVAL_UNDEF(&entry->val);
+	entry->ttl = ttl;
+	entry->next = NULL;
+	entry->ctime = APC_CACHE_REL_TIME(cache, t);
+
+	cold->pool = NULL;
+	cold->epoch = 0;
+	cold->mem_size = 0; /* set on insertion, from the size of the pool */
+	cold->nhits = 0;
+	cold->mtime = entry->ctime;
+	cold->atime = entry->ctime;
+	cold->dtime = 0;
+	cold->referenced = 1;
+	cold->grace = 0;
+	cold->refresh = 0;
+	cold->delta = 0;
+	cold->flags = 0;
+	cold->slide = entry->ctime;
+	cold->offset = (uint32_t) ((char *) cold - (char *) mem);
+	cold->wnext = NULL;
+	cold->wprev = NULL;
+
+	return entry;
+}
+/* }}} */
+
+/* {{{ apc_cache_jitter_ttl
+ Shortens ttl by a random number of seconds, up to jitter percent of it, so that entries
+ stored at the same time with the same ttl do not all expire in the same second */
+static int32_t apc_cache_jitter_ttl(int32_t ttl, zend_long jitter)
+{
+	int32_t spread;
+
+	if (ttl <= 1 || jitter <= 0) {
+		return ttl;
+	}
+
+	if (jitter > 100) {
+		jitter = 100;
+	}
+
+	/* entries never outlive the ttl they were stored with, nor expire right away */
+	spread = (int32_t) (((int64_t) ttl * jitter) / 100);
+	if (spread >= ttl) {
+		spread = ttl - 1;
+	}
+
+	if (spread <= 0) {
+		return ttl;
+	}
+
+	return ttl - (int32_t) (apc_cache_worker_random() % (uint32_t) (spread + 1));
+}
+/* }}} */
+
 /* {{{ apc_cache_make_entry */
 static apc_cache_entry_t *apc_cache_make_entry(
-		apc_context_t *ctxt, zend_string *key, const zval* val, const int32_t ttl, time_t t)
+		apc_cache_t *cache, apc_context_t *ctxt, zend_string *key,
+		const zval* val, const int32_t ttl, zend_long jitter, time_t t)
 {
-	zend_string *copied_key;
-	apc_cache_entry_t *entry = APC_POOL_ALLOC(sizeof(apc_cache_entry_t));
-	if (!entry) {
+	apc_cache_entry_t *entry;
+	void *mem = APC_POOL_ALLOC(APC_CACHE_ENTRY_SIZE(ZSTR_LEN(key)));
+	if (!mem) {
 		return NULL;
 	}
 
-	/* copy key into pool */
-	copied_key = APC_POOL_STRING_DUP(key);
-	if (!copied_key) {
-		return NULL;
-	}
+	entry = apc_cache_init_entry(cache, mem, key, apc_cache_jitter_ttl(ttl, jitter), t);
 
 	if (!apc_cache_store_zval(&entry->val, val, ctxt)) {
 		return NULL;
 	}
 
-	entry->pool = ctxt->pool;
-	entry->ttl = ttl;
-	entry->key = copied_key;
-
-	entry->next = NULL;
-	entry->ref_count = 0;
-	entry->mem_size = 0; /* TODO Initialize here already? */
-	entry->nhits = 0;
-	entry->ctime = t;
-	entry->mtime = t;
-	entry->atime = t;
-	entry->dtime = 0;
+	APC_CACHE_ENTRY_COLD(entry)->pool = ctxt->pool;
 
 	return entry;
 }
@@ -1518,19 +3377,21 @@ static apc_cache_entry_t *apc_cache_make_entry(
 static zval apc_cache_link_info(apc_cache_t *cache, apc_cache_entry_t *p)
 {
 	zval link;
+	apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(p);
 
 	array_init(&link);
 
-	add_assoc_str(&link, "info", zend_string_dup(p->key, 0));
+	add_assoc_str(&link, "info", zend_string_dup(&p->key, 0));
 	add_assoc_long(&link, "ttl", p->ttl);
 
-	add_assoc_double(&link, "num_hits", (double)p->nhits);
-	add_assoc_long(&link, "mtime", p->mtime);
-	add_assoc_long(&link, "creation_time", p->ctime);
-	add_assoc_long(&link, "deletion_time", p->dtime);
-	add_assoc_long(&link, "access_time", p->atime);
-	add_assoc_long(&link, "ref_count", p->ref_count);
-	add_assoc_long(&link, "mem_size", p->mem_size);
+	add_assoc_double(&link, "num_hits", (double)cold->nhits);
+	add_assoc_long(&link, "mtime", APC_CACHE_ABS_TIME(cache, cold->mtime));
+	add_assoc_long(&link, "creation_time", APC_CACHE_ABS_TIME(cache, p->ctime));
+	add_assoc_long(&link, "deletion_time", APC_CACHE_ABS_TIME(cache, cold->dtime));
+	add_assoc_long(&link, "access_time", APC_CACHE_ABS_TIME(cache, cold->atime));
+	add_assoc_long(&link, "ref_count", 0);
+	add_assoc_long(&link, "mem_size", cold->mem_size);
+	add_assoc_bool(&link, "pinned", (cold->flags & APC_CACHE_ENTRY_PINNED) != 0);
 
 	return link;
 }
@@ -1543,23 +3404,36 @@ PHP_APCU_API zend_bool apc_cache_info(zval *info, apc_cache_t *cache, zend_bool
 	zval gc;
 	zval slots;
 	apc_cache_entry_t *p;
-	zend_ulong i, j;
+	zend_long i, j, k, base;
+	zend_long nhits = 0, nmisses = 0;
 
 	if (!cache) {
 		ZVAL_NULL(info);
 		return 0;
 	}
 
-	APC_RLOCK(cache->header);
+	apc_cache_rlock_all(cache);
 	php_apc_try {
+		/* tables grow on their own */
+		for (i = 0, base = 0; i < cache->nshards; i++) {
+			base += APC_CACHE_SHARD(cache, i)->table->nslots;
+		}
+
 		array_init(info);
-		add_assoc_long(info, "num_slots", cache->nslots);
+		add_assoc_long(info, "num_slots", base);
 		add_assoc_long(info, "ttl", cache->ttl);
-		add_assoc_double(info, "num_hits", (double)cache->header->nhits);
-		add_assoc_double(info, "num_misses", (double)cache->header->nmisses);
+
+		for (i = 0; i < APC_CACHE_COUNTERS; i++) {
+			nhits += cache->counters[i].nhits;
+			nmisses += cache->counters[i].nmisses;
+		}
+
+		add_assoc_double(info, "num_hits", (double)nhits);
+		add_assoc_double(info, "num_misses", (double)nmisses);
 		add_assoc_double(info, "num_inserts", (double)cache->header->ninserts);
 		add_assoc_long(info,   "num_entries", cache->header->nentries);
 		add_assoc_double(info, "expunges", (double)cache->header->nexpunges);
+		add_assoc_long(info, "generation", cache->header->generation);
 		add_assoc_long(info, "start_time", cache->header->stime);
 		add_assoc_double(info, "mem_size", (double)cache->header->mem_size);
 
@@ -1574,33 +3448,40 @@ PHP_APCU_API zend_bool apc_cache_info(zval *info, apc_cache_t *cache, zend_bool
 			array_init(&list);
 			array_init(&slots);
 
-			for (i = 0; i < cache->nslots; i++) {
-				p = cache->slots[i];
-				j = 0;
-				for (; p != NULL; p = p->next) {
-					zval link = apc_cache_link_info(cache, p);
-					add_next_index_zval(&list, &link);
-					j++;
-				}
-				if (j != 0) {
-					add_index_long(&slots, (ulong)i, j);
+			for (i = 0, base = 0; i < cache->nshards; i++) {
+				apc_cache_shard_t *shard = APC_CACHE_SHARD(cache, i);
+
+				for (k = 0; k < APC_CACHE_SHARD_NSLOTS(shard); k++) {
+					p = APC_CACHE_SHARD_BUCKET(shard, k)->head;
+					j = 0;
+					for (; p != NULL; p = p->next) {
+						zval link = apc_cache_link_info(cache, p);
+						add_next_index_zval(&list, &link);
+						j++;
+					}
+					if (j != 0) {
+						add_index_long(&slots, (ulong)(base + k), j);
+					}
 				}
+				base += APC_CACHE_SHARD_NSLOTS(shard);
 			}
 
 			/* For each slot pending deletion */
 			array_init(&gc);
 
+			APC_RLOCK(cache->header);
 			for (p = cache->header->gc; p != NULL; p = p->next) {
 				zval link = apc_cache_link_info(cache, p);
 				add_next_index_zval(&gc, &link);
 			}
+			APC_RUNLOCK(cache->header);
 
 			add_assoc_zval(info, "cache_list", &list);
 			add_assoc_zval(info, "deleted_list", &gc);
 			add_assoc_zval(info, "slot_distribution", &slots);
 		}
 	} php_apc_finally {
-		APC_RUNLOCK(cache->header);
+		apc_cache_runlock_all(cache);
 	} php_apc_end_try();
 
 	return 1;
@@ -1611,40 +3492,33 @@ PHP_APCU_API zend_bool apc_cache_info(zval *info, apc_cache_t *cache, zend_bool
  fetches information about the key provided
 */
 PHP_APCU_API zval *apc_cache_stat(apc_cache_t *cache, zend_string *key, zval *stat) {
-	zend_ulong h, s;
+	apc_cache_shard_t *shard;
+	zend_ulong h;
 
-	/* calculate hash and slot */
-	apc_cache_hash_slot(cache, key, &h, &s);
+	/* calculate hash and shard */
+	apc_cache_hash_shard(cache, key, &h, &shard);
 
-	APC_RLOCK(cache->header);
+	APC_RLOCK(shard);
 	php_apc_try {
-		/* find head */
-		apc_cache_entry_t *entry = cache->slots[s];
-
-		while (entry) {
-			/* check for a matching key by has and identifier */
-			if (h == ZSTR_HASH(entry->key) &&
-				ZSTR_LEN(entry->key) == ZSTR_LEN(key) &&
-				memcmp(ZSTR_VAL(entry->key), ZSTR_VAL(key), ZSTR_LEN(key)) == SUCCESS
-			) {
-				array_init(stat);
-
-				add_assoc_long(stat, "hits",  entry->nhits);
-				add_assoc_long(stat, "access_time", entry->atime);
-				add_assoc_long(stat, "mtime", entry->mtime);
-				add_assoc_long(stat, "creation_time", entry->ctime);
-				add_assoc_long(stat, "deletion_time", entry->dtime);
-				add_assoc_long(stat, "ttl", entry->ttl);
-				add_assoc_long(stat, "refs", entry->ref_count);
-
-				break;
-			}
-
-			/* next */
-			entry = entry->next;
+		/* find entry */
+		apc_cache_entry_t *entry = apc_cache_rlocked_lookup(cache, shard, key, h);
+
+		if (entry) {
+			apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
+
+			array_init(stat);
+
+			add_assoc_long(stat, "hits",  cold->nhits);
+			add_assoc_long(stat, "access_time", APC_CACHE_ABS_TIME(cache, cold->atime));
+			add_assoc_long(stat, "mtime", APC_CACHE_ABS_TIME(cache, cold->mtime));
+			add_assoc_long(stat, "creation_time", APC_CACHE_ABS_TIME(cache, entry->ctime));
+			add_assoc_long(stat, "deletion_time", APC_CACHE_ABS_TIME(cache, cold->dtime));
+			add_assoc_long(stat, "ttl", entry->ttl);
+			add_assoc_long(stat, "refs", 0);
+			add_assoc_bool(stat, "pinned", (cold->flags & APC_CACHE_ENTRY_PINNED) != 0);
 		}
 	} php_apc_finally {
-		APC_RUNLOCK(cache->header);
+		APC_RUNLOCK(shard);
 	} php_apc_end_try();
 
 	return stat;
@@ -1664,36 +3538,25 @@ PHP_APCU_API zend_bool apc_cache_defense(apc_cache_t *cache, zend_string *key, t
 
 	/* only continue if slam defense is enabled */
 	if (cache->defend) {
-
-		/* for copy of locking key struct */
-		apc_cache_slam_key_t *last = &cache->header->lastkey;
-
-		if (!last->hash) {
-			return 0;
-		}
+		/* the slot of the key in the table of recent inserts */
+		apc_cache_slam_key_t *last = &cache->slam_keys[ZSTR_HASH(key) & cache->slam_mask];
+		apc_cache_owner_t owner = apc_cache_owner();
 
 		/* check the hash and length match */
-		if (last->hash == ZSTR_HASH(key) && last->len == ZSTR_LEN(key)) {
-			apc_cache_owner_t owner;
-#ifdef ZTS
-			owner = TSRMLS_CACHE;
-#else
-			owner = getpid();
-#endif
-
-			/* check the time (last second considered slam) and context */
-			if (last->mtime == t && last->owner != owner) {
+		if (last->hash == ZSTR_HASH(key) && last->len == ZSTR_LEN(key) && last->mtime == t) {
+			/* check the context (last second considered slam) */
+			if (last->owner != owner) {
 				/* potential cache slam */
 				apc_debug(
 					"Potential cache slam averted for key '%s'", ZSTR_VAL(key));
 				result = 1;
-			} else {
-				/* sets enough information for an educated guess, but is not exact */
-				last->hash = ZSTR_HASH(key);
-				last->len = ZSTR_LEN(key);
-				last->mtime = t;
-				last->owner = owner;
 			}
+		} else {
+			/* sets enough information for an educated guess, but is not exact */
+			last->hash = ZSTR_HASH(key);
+			last->len = ZSTR_LEN(key);
+			last->mtime = t;
+			last->owner = owner;
 		}
 	}
 
@@ -1708,63 +3571,210 @@ PHP_APCU_API void apc_cache_serializer(apc_cache_t* cache, const char* name) {
 	}
 } /* }}} */
 
-PHP_APCU_API void apc_cache_entry(apc_cache_t *cache, zval *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc, zend_long ttl, zend_long now, zval *return_value) {/*{{{*/
-	apc_cache_entry_t *entry = NULL;
+/* {{{ apc_cache_entry_claim_refresh
+ Hands out the refresh of a stale entry to one caller. The refresh is handed out again
+ APC_CACHE_REFRESH_TIMEOUT seconds later, in case the caller failed to store a new value */
+static zend_bool apc_cache_entry_claim_refresh(apc_cache_t *cache, apc_cache_entry_t *entry, time_t t) {
+	apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
+	uint32_t refresh = cold->refresh;
 
-	if(!cache || apc_cache_busy(cache)) {
-		return;
+	if (refresh && APC_CACHE_ABS_TIME(cache, refresh) + APC_CACHE_REFRESH_TIMEOUT > t) {
+		return 0;
 	}
 
-	if (!key || Z_TYPE_P(key) != IS_STRING) {
-		/* only strings, for now */
-		return;
+	return ATOMIC_CAS32(cold->refresh, refresh, APC_CACHE_REL_TIME(cache, t));
+} /* }}} */
+
+/* {{{ apc_cache_entry_refresh_early
+ Decides whether an entry which did not expire yet is refreshed anyway (XFetch). The
+ probability grows as the expiry nears, and with the time the value took to generate,
+ beta scales it: larger values refresh earlier */
+static zend_bool apc_cache_entry_refresh_early(
+		apc_cache_t *cache, apc_cache_entry_t *entry, time_t t, double beta) {
+	apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
+	double gap;
+
+	if (!entry->ttl || !cold->delta) {
+		return 0;
 	}
 
-#ifndef APC_LOCK_RECURSIVE
-	if (APCG(recursion)++ == 0) {
-		if (!APC_WLOCK(cache->header)) {
-			APCG(recursion)--;
-			return;
+	gap = (cold->delta / 1000.0) * beta * -log(apc_cache_worker_random() / 4294967296.0);
+
+	return (double) t + gap >= (double) (APC_CACHE_ABS_TIME(cache, APC_CACHE_ENTRY_START(entry)) + entry->ttl);
+} /* }}} */
+
+/* {{{ apc_cache_flight_find
+ Returns the marker of key, or NULL. Without the header lock held, the result is a hint */
+static apc_cache_flight_t *apc_cache_flight_find(apc_cache_t *cache, zend_string *key, apc_cache_flight_t **free) {
+	zend_ulong h = ZSTR_HASH(key);
+	int i;
+
+	for (i = 0; i < APC_CACHE_FLIGHT_PROBES; i++) {
+		apc_cache_flight_t *flight = &cache->header->flights[(h + i) % APC_CACHE_FLIGHTS];
+
+		if (flight->hash == h && flight->len == ZSTR_LEN(key)) {
+			return flight;
+		}
+
+		if (free && !flight->hash && !*free) {
+			*free = flight;
 		}
 	}
-#else
+
+	return NULL;
+} /* }}} */
+
+/* {{{ apc_cache_flight_begin
+ Marks the value of key as being generated by this worker. Returns 0 when another worker
+ generates it already, unless force is set, then the marker is taken over. When every
+ marker the key may take is in use, the value is generated without a marker */
+static zend_bool apc_cache_flight_begin(apc_cache_t *cache, zend_string *key, zend_bool force) {
+	apc_cache_owner_t owner = apc_cache_owner();
+	apc_cache_flight_t *flight, *free = NULL;
+	zend_bool result = 1;
+
+	if (!APC_WLOCK(cache->header)) {
+		return 1;
+	}
+
+	flight = apc_cache_flight_find(cache, key, &free);
+	if (flight) {
+		if (flight->owner != owner && !force) {
+			result = 0;
+		} else {
+			flight->owner = owner;
+		}
+	} else if (free) {
+		free->hash = ZSTR_HASH(key);
+		free->len = ZSTR_LEN(key);
+		free->owner = owner;
+	}
+
+	APC_WUNLOCK(cache->header);
+
+	return result;
+} /* }}} */
+
+/* {{{ apc_cache_flight_end
+ Removes the marker of key, if this worker still owns it */
+static void apc_cache_flight_end(apc_cache_t *cache, zend_string *key) {
+	apc_cache_flight_t *flight;
+
 	if (!APC_WLOCK(cache->header)) {
 		return;
 	}
-#endif
 
-	php_apc_try {
-		entry = apc_cache_rlocked_find_incref(cache, Z_STR_P(key), now);
-		if (!entry) {
-			int result;
-			zval params[1];
-			ZVAL_COPY(&params[0], key);
+	flight = apc_cache_flight_find(cache, key, NULL);
+	if (flight && flight->owner == apc_cache_owner()) {
+		memset(flight, 0, sizeof(apc_cache_flight_t));
+	}
+
+	APC_WUNLOCK(cache->header);
+} /* }}} */
 
-			fci->retval = return_value;
-			fci->param_count = 1;
-			fci->params = params;
+/* {{{ apc_cache_flight_wait
+ Waits for the marker of key to be removed, for at most entry_wait milliseconds. The
+ marker is polled without the header lock, backing off up to APC_CACHE_FLIGHT_POLL ms */
+static void apc_cache_flight_wait(apc_cache_t *cache, zend_string *key) {
+	zend_long waited = 0, step = 1;
+
+	while (waited < cache->entry_wait && apc_cache_flight_find(cache, key, NULL)) {
+		usleep(step * 1000);
+		waited += step;
+		if (step < APC_CACHE_FLIGHT_POLL) {
+			step <<= 1;
+		}
+	}
+} /* }}} */
 
-			result = zend_call_function(fci, fcc);
+/* {{{ apc_cache_entry_lookup
+ Fetches the value of key for apc_cache_entry into return_value, stale values included,
+ without taking any lock unless racing a writer. Returns 0 when the value must be generated,
+ refresh is then set if the caller got to refresh a stale value, or one due for an early refresh */
+static zend_bool apc_cache_entry_lookup(
+		apc_cache_t *cache, zend_string *key, zend_long now, double beta,
+		zend_bool *refresh, zval *return_value) {
+	apc_cache_shard_t *locked;
+	apc_cache_reader_t *reader = apc_cache_read_enter(cache, key, &locked);
+	apc_cache_entry_t *entry;
+	zend_bool stale = 0, done = 0;
 
-			zval_ptr_dtor(&params[0]);
+	php_apc_try {
+		entry = apc_cache_section_find(cache, key, now, &stale, locked);
+		if (entry) {
+			zend_bool due = stale ||
+				(beta > 0 && apc_cache_entry_refresh_early(cache, entry, now, beta));
 
-			if (result == SUCCESS && !EG(exception)) {
-				apc_cache_store_internal(
-					cache, Z_STR_P(key), return_value, (uint32_t) ttl, 1);
+			if (due && apc_cache_entry_claim_refresh(cache, entry, now)) {
+				*refresh = 1;
+			} else {
+				done = apc_cache_entry_fetch_zval(cache, entry, return_value);
 			}
-		} else {
-			apc_cache_entry_fetch_zval(cache, entry, return_value);
-			apc_cache_entry_release(cache, entry);
 		}
 	} php_apc_finally {
-#ifndef APC_LOCK_RECURSIVE
-		if (--APCG(recursion) == 0) {
-			APC_WUNLOCK(cache->header);
+		apc_cache_read_leave(cache, reader, locked);
+	} php_apc_end_try();
+
+	return done;
+} /* }}} */
+
+PHP_APCU_API void apc_cache_entry(apc_cache_t *cache, zval *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc, zend_long ttl, zend_long grace, double beta, zend_long now, zval *return_value) {/*{{{*/
+	zend_bool refresh = 0;
+
+	if(!cache || apc_cache_busy(cache)) {
+		return;
+	}
+
+	if (!key || Z_TYPE_P(key) != IS_STRING) {
+		/* only strings, for now */
+		return;
+	}
+
+	if (apc_cache_entry_lookup(cache, Z_STR_P(key), now, beta, &refresh, return_value)) {
+		return;
+	}
+
+	/* mark the key as being generated, the refresh of a stale value was handed out
+	 * to this caller alone, so it takes the marker over */
+	if (!apc_cache_flight_begin(cache, Z_STR_P(key), refresh)) {
+		apc_cache_flight_wait(cache, Z_STR_P(key));
+
+		if (apc_cache_entry_lookup(cache, Z_STR_P(key), now, 0, &refresh, return_value)) {
+			return;
 		}
-#else
-		APC_WUNLOCK(cache->header);
-#endif
 
+		/* the value was not stored in time, generate it here */
+		apc_cache_flight_begin(cache, Z_STR_P(key), 1);
+	}
+
+	php_apc_try {
+		int result;
+		zval params[1];
+		struct timeval start, end;
+		ZVAL_COPY(&params[0], key);
+
+		fci->retval = return_value;
+		fci->param_count = 1;
+		fci->params = params;
+
+		/* the time the generator takes is kept with the entry, see apc_cache_entry_refresh_early */
+		gettimeofday(&start, NULL);
+		result = zend_call_function(fci, fcc);
+		gettimeofday(&end, NULL);
+
+		zval_ptr_dtor(&params[0]);
+
+		if (result == SUCCESS && !EG(exception)) {
+			zend_long delta = (zend_long) (end.tv_sec - start.tv_sec) * 1000
+				+ (end.tv_usec - start.tv_usec) / 1000;
+
+			/* a refreshed entry is replaced, even if it did not expire yet */
+			apc_cache_store_internal(
+				cache, Z_STR_P(key), return_value, (uint32_t) ttl, (uint32_t) grace,
+				delta > 0 ? (uint32_t) delta : 0, !refresh);
+		}
+	} php_apc_finally {
+		apc_cache_flight_end(cache, Z_STR_P(key));
 	} php_apc_end_try();
 }
 /*}}}*/
@@ -44,24 +44,84 @@ struct apc_cache_slam_key_t {
 	apc_cache_owner_t owner; /* the context that created this key */
 };
 
-/* {{{ struct definition: apc_cache_entry_t */
+/* number of values which can be marked as being generated at once,
+   and the number of consecutive markers the key of a value may take */
+#define APC_CACHE_FLIGHTS       64
+#define APC_CACHE_FLIGHT_PROBES 4
+
+/* {{{ struct definition: apc_cache_flight_t
+   Marks the value of a key as being generated by apc_cache_entry, so that concurrent
+   callers wait for it rather than generating it again. Markers are matched by hash
+   and length of the key, like the slam defense. */
+typedef struct apc_cache_flight_t {
+	zend_ulong hash;         /* hash of the key, 0 for a free marker */
+	size_t len;              /* length of the key */
+	apc_cache_owner_t owner; /* the context generating the value */
+} apc_cache_flight_t; /* }}} */
+
+/* {{{ struct definition: apc_cache_entry_cold_t
+   The part of an entry which lookups do not read, it is written on hits and
+   by the gc, and lives right in front of the entry it belongs to. Times are
+   seconds since the time base of the cache, see APC_CACHE_ABS_TIME. */
+typedef struct apc_cache_entry_cold_t {
+	zend_long nhits;         /* number of hits to this entry */
+	zend_ulong epoch;        /* epoch the entry was removed in */
+	zend_long mem_size;      /* memory used */
+	apc_pool *pool;          /* pool which allocated the entry and the value */
+	uint32_t mtime;          /* the mtime of this cached entry */
+	uint32_t dtime;          /* time entry was removed from cache */
+	uint32_t atime;          /* time entry was last accessed */
+	uint32_t referenced;     /* set by hits, cleared by the clock hand */
+	uint32_t grace;          /* seconds the entry may be returned stale once hard expired */
+	uint32_t refresh;        /* time a refresh of the stale entry was handed out */
+	uint32_t delta;          /* milliseconds the value took to generate, see apc_cache_entry */
+	uint32_t flags;          /* APC_CACHE_ENTRY_* flags given when the entry was stored */
+	uint32_t slide;          /* time the ttl of a sliding entry last started over, never before ctime */
+	uint32_t offset;         /* bytes from the start of the allocation to the cold part */
+	struct apc_cache_entry_t *wnext;  /* next entry in the same slot of the timing wheel */
+	struct apc_cache_entry_t **wprev; /* link to this entry in the timing wheel, NULL if not linked */
+} apc_cache_entry_cold_t;
+/* }}} */
+
+/* {{{ struct definition: apc_cache_entry_t
+   The part of an entry which lookups read, followed by the key itself.
+   The key must stay the last member, its characters run past the end of
+   the struct. Entries start on a cache line, so that the members and the
+   header of the key are read from a single line. */
 typedef struct apc_cache_entry_t apc_cache_entry_t;
 struct apc_cache_entry_t {
-	zend_string *key;        /* entry key */
-	zval val;                /* the zval copied at store time */
 	apc_cache_entry_t *next; /* next entry in linked list */
-	zend_long ttl;           /* the ttl on this specific entry */
-	zend_long ref_count;     /* the reference count of this entry */
-	zend_long nhits;         /* number of hits to this entry */
-	time_t ctime;            /* time entry was initialized */
-	time_t mtime;            /* the mtime of this cached entry */
-	time_t dtime;            /* time entry was removed from cache */
-	time_t atime;            /* time entry was last accessed */
-	zend_long mem_size;      /* memory used */
-	apc_pool *pool;	         /* pool which allocated the value */
+	zval val;                /* the zval copied at store time */
+	int32_t ttl;             /* the ttl on this specific entry */
+	uint32_t ctime;          /* time entry was initialized */
+	zend_string key;         /* entry key, stored inline */
 };
 /* }}} */
 
+/* size of an entry for a key of len characters, including the cold part and
+   room to align the entry to a cache line */
+#define APC_CACHE_ENTRY_SIZE(len) \
+	(sizeof(apc_cache_entry_cold_t) + APC_CACHE_LINE_SIZE \
+		+ XtOffsetOf(apc_cache_entry_t, key) + _ZSTR_STRUCT_SIZE(len))
+
+/* cold part of an entry */
+#define APC_CACHE_ENTRY_COLD(entry) (((apc_cache_entry_cold_t *) (entry)) - 1)
+
+/* {{{ entry flags */
+#define APC_CACHE_ENTRY_PINNED  0x00000001 /* never evicted, only removed by its ttl, deletes and clears */
+#define APC_CACHE_ENTRY_SLIDING 0x00000002 /* the ttl starts over whenever the entry is hit */
+/* }}} */
+
+/* the time the ttl of an entry started. Sliding entries start over on hits, which lookups
+   record in the cold part. As the start is never before the creation time, callers only
+   need it once the creation time says the entry expired */
+#define APC_CACHE_ENTRY_START(entry) \
+	((APC_CACHE_ENTRY_COLD(entry)->flags & APC_CACHE_ENTRY_SLIDING) \
+		? APC_CACHE_ENTRY_COLD(entry)->slide : (entry)->ctime)
+
+/* entries without a value record a key as known to be missing, they have no pool */
+#define APC_CACHE_ENTRY_MISSING(entry) (Z_TYPE((entry)->val) == IS_UNDEF)
+
 /* {{{ state constants */
 #define APC_CACHE_ST_NONE  0
 #define APC_CACHE_ST_BUSY  0x00000001 /* }}} */
@@ -69,31 +129,194 @@ struct apc_cache_entry_t {
 /* {{{ struct definition: apc_cache_header_t
    Any values that must be shared among processes should go in here. */
 typedef struct _apc_cache_header_t {
-	apc_lock_t lock;                /* header lock */
-	zend_long nhits;                /* hit count */
-	zend_long nmisses;              /* miss count */
+	apc_lock_t lock;                /* header lock (guards the gc list and the epoch) */
 	zend_long ninserts;             /* insert count */
 	zend_long nexpunges;            /* expunge count */
 	zend_long nentries;             /* entry count */
 	zend_long mem_size;             /* used */
 	time_t stime;                   /* start time */
+	time_t tbase;                   /* base of the times kept in entries */
 	unsigned short state;           /* cache state */
-	apc_cache_slam_key_t lastkey;   /* last key inserted (not necessarily without error) */
-	apc_cache_entry_t *gc;          /* gc list */
+	apc_cache_entry_t *gc;          /* gc list of removed entries, oldest first */
+	apc_cache_entry_t **gc_tail;    /* last link of the gc list */
+	zend_ulong epoch;               /* epoch readers announce, advanced by the gc */
+	time_t epoch_held;              /* time the gc found the epoch held back, 0 if it advanced */
+	struct _apc_cache_table_t *retired; /* slot tables waiting to be freed */
+	struct _apc_cache_table_t *cleared; /* slot tables swapped out by clears, oldest first */
+	zend_long cleared_slot;         /* next slot of the first cleared table to reclaim */
+	zend_ulong generation;          /* number of clears since the cache was created */
+	zend_long clock_shard;          /* shard under the clock hand */
+	zend_long clock_slot;           /* slot under the clock hand */
+	zend_long sweep_shard;          /* shard under the sweep cursor */
+	zend_long sweep_slot;           /* slot under the sweep cursor */
+	time_t sweep_time;              /* time of the last sweep */
+	apc_cache_flight_t flights[APC_CACHE_FLIGHTS]; /* values being generated by apc_cache_entry */
 } apc_cache_header_t; /* }}} */
 
+/* number of shards the hit and miss counters are spread over */
+#define APC_CACHE_COUNTERS 32
+
+/* {{{ struct definition: apc_cache_counters_t
+   Counters kept per worker slot, every worker counts into the shard selected by
+   its counter slot, and each shard has a cache line to itself, so that counting
+   does not invalidate the cache lines other workers count into. The counts
+   of the cache are the sums over all shards. */
+typedef struct _apc_cache_counters_t {
+	zend_long nhits;                /* hit count */
+	zend_long nmisses;              /* miss count */
+	zend_long sketch_additions;     /* frequencies recorded since the sketch was last aged */
+	char pad[APC_CACHE_LINE_SIZE - 3 * sizeof(zend_long)];
+} apc_cache_counters_t; /* }}} */
+
+/* default number of read sections which can be open at once, over all workers */
+#define APC_CACHE_READERS 1024
+
+/* {{{ struct definition: apc_cache_reader_t
+   A read section, see apc_cache_epoch_enter. Workers claim a free slot for every
+   section they enter and free it when they leave, each slot has a cache line to
+   itself. The owner is kept so that the gc can tell the sections of workers which
+   died in them, and free their slots rather than waiting for them forever. */
+typedef struct _apc_cache_reader_t {
+	apc_cache_owner_t owner;        /* the context in the section, 0 for a free slot */
+	zend_ulong epoch;               /* epoch the section was entered in */
+	char pad[APC_CACHE_LINE_SIZE - sizeof(apc_cache_owner_t) - sizeof(zend_ulong)];
+} apc_cache_reader_t; /* }}} */
+
+/* number of entries returned by apc_cache_find a worker can hold at once */
+#define APC_CACHE_HOLDS 32
+
+/* {{{ struct definition: apc_cache_hold_t
+   The read section a worker keeps open for an entry returned by apc_cache_find,
+   until the entry is released. Kept in the worker globals. */
+typedef struct _apc_cache_hold_t {
+	struct _apc_cache_t *cache;     /* cache the entry belongs to */
+	apc_cache_entry_t *entry;       /* entry held */
+	apc_cache_reader_t *reader;     /* section open in the cache */
+} apc_cache_hold_t; /* }}} */
+
+/* entries keep times as seconds since the time base of the cache, which
+   never changes over the life of the cache, zero stands for no time */
+#define APC_CACHE_REL_TIME(cache, t) \
+	((t) > (cache)->header->tbase ? (uint32_t) ((t) - (cache)->header->tbase) : (uint32_t) ((t) ? 1 : 0))
+#define APC_CACHE_ABS_TIME(cache, t) \
+	((t) ? (time_t) ((cache)->header->tbase + (t)) : (time_t) 0)
+
+/* number of entries a bucket keeps a hash tag for */
+#define APC_CACHE_BUCKET_TAGS 4
+
+/* {{{ struct definition: apc_cache_bucket_t
+   A slot, sized to a cache line. The first entries of the chain are indexed
+   with a tag taken from the hash of their key, so that lookups can reject
+   them without touching the memory of the entries. */
+typedef struct _apc_cache_bucket_t {
+	uint32_t tags[APC_CACHE_BUCKET_TAGS];                  /* tags of the first entries */
+	apc_cache_entry_t *head;                               /* chain of entries */
+	apc_cache_entry_t *entries[APC_CACHE_BUCKET_TAGS];     /* first entries of the chain */
+	char pad[APC_CACHE_LINE_SIZE
+		- (APC_CACHE_BUCKET_TAGS + 1) * sizeof(apc_cache_entry_t *)
+		- APC_CACHE_BUCKET_TAGS * sizeof(uint32_t)];
+} apc_cache_bucket_t; /* }}} */
+
+/* {{{ struct definition: apc_cache_table_t
+   A table of slots, the number of slots is kept with the slots themselves
+   so that readers without the lock always see a matching pair. */
+typedef struct _apc_cache_table_t {
+	zend_long nslots;                   /* number of slots */
+	zend_ulong mask;                    /* nslots - 1 if nslots is a power of two, otherwise 0 */
+	struct _apc_cache_table_t *next;    /* next retired or cleared table */
+	zend_ulong epoch;                   /* epoch the table was retired or cleared in */
+	zend_bool allocated;                /* table was allocated from the SMA */
+	apc_cache_bucket_t *slots;          /* slots, aligned to a cache line */
+} apc_cache_table_t; /* }}} */
+
+/* size of a table of n slots, including room to align the slots */
+#define APC_CACHE_TABLE_SIZE(n) \
+	(ALIGNWORD(sizeof(apc_cache_table_t)) + APC_CACHE_LINE_SIZE + (n) * sizeof(apc_cache_bucket_t))
+
+/* levels of a timing wheel, and slots per level */
+#define APC_CACHE_WHEEL_LEVELS 4
+#define APC_CACHE_WHEEL_BITS   6
+#define APC_CACHE_WHEEL_SLOTS  (1 << APC_CACHE_WHEEL_BITS)
+
+/* {{{ struct definition: apc_cache_wheel_t
+   Hierarchical timing wheel indexing the entries with a ttl by the time they
+   expire. Level 0 has a slot for each of the next 64 seconds, every further
+   level has slots spanning 64 times as long. When the wheel is advanced past
+   the span of a slot of a higher level, the entries of that slot are moved
+   down to the levels below, so that entries expire from level 0. */
+typedef struct _apc_cache_wheel_t {
+	uint32_t now;                   /* time the wheel was advanced to */
+	zend_long nentries;             /* number of entries in the wheel */
+	struct apc_cache_entry_t *slots[APC_CACHE_WHEEL_LEVELS][APC_CACHE_WHEEL_SLOTS];
+} apc_cache_wheel_t; /* }}} */
+
+/* {{{ struct definition: apc_cache_shard_t
+   A shard owns a part of the slots, and the lock which guards them.
+   An entry always lives in the shard selected by the hash of its key.
+   When the table of a shard grows, entries migrate from old_table to table
+   a few slots at a time, while old_table is set entries may be in either. */
+typedef struct _apc_cache_shard_t {
+	apc_lock_t lock;                /* shard lock */
+	apc_cache_table_t *table;       /* slots of this shard (stored in SHM) */
+	apc_cache_table_t *old_table;   /* table being migrated from, or NULL */
+	zend_long rehash_idx;           /* next slot of old_table to migrate */
+	zend_long nentries;             /* number of entries in this shard */
+	volatile zend_ulong seq;        /* sequence, odd while a writer changes the slots */
+	apc_cache_wheel_t wheel;        /* expiry index of the entries of this shard with a ttl */
+	apc_cache_entry_t *pending;     /* removed entries not on the gc list yet */
+	apc_cache_entry_t **pending_tail; /* last link of the pending list */
+} apc_cache_shard_t; /* }}} */
+
+/* shards are laid out on cache line boundaries, so that taking the lock
+   of one shard does not invalidate the cache line of its neighbours */
+#define APC_CACHE_SHARD_SIZE ALIGNSIZE(sizeof(apc_cache_shard_t), APC_CACHE_LINE_SIZE)
+#define APC_CACHE_SHARD(cache, i) \
+	((apc_cache_shard_t *) (((char *) (cache)->shards) + (i) * APC_CACHE_SHARD_SIZE))
+
+/* number of slots of a shard, including those of a table being migrated from,
+   APC_CACHE_SHARD_BUCKET returns the bucket of slot i in that range */
+#define APC_CACHE_SHARD_NSLOTS(shard) \
+	((shard)->table->nslots + ((shard)->old_table ? (shard)->old_table->nslots : 0))
+#define APC_CACHE_SHARD_BUCKET(shard, i) \
+	((i) < (shard)->table->nslots ? \
+		&(shard)->table->slots[(i)] : &(shard)->old_table->slots[(i) - (shard)->table->nslots])
+
+/* {{{ eviction policies, see apc_cache_default_expunge */
+#define APC_CACHE_EVICT_EXPUNGE 0 /* remove every entry */
+#define APC_CACHE_EVICT_CLOCK   1 /* remove entries not hit since the clock hand last passed */
+/* }}} */
+
 /* {{{ struct definition: apc_cache_t */
 typedef struct _apc_cache_t {
 	void* shmaddr;                /* process (local) address of shared cache */
 	apc_cache_header_t* header;   /* cache header (stored in SHM) */
-	apc_cache_entry_t** slots;    /* array of cache slots (stored in SHM) */
+	apc_cache_shard_t* shards;    /* array of lock shards (stored in SHM) */
+	apc_cache_counters_t* counters; /* array of counter shards (stored in SHM) */
+	apc_cache_reader_t* readers;  /* slots of the read sections (stored in SHM) */
+	zend_long nreaders;           /* number of slots of read sections */
+	apc_cache_owner_t reader_owner; /* process the stale sections were freed for, see apc_cache_epoch_enter */
+	unsigned char* sketch;        /* frequency sketch used for admission, or NULL (stored in SHM) */
+	zend_ulong sketch_mask;       /* counters per row of the sketch - 1 */
+	zend_long nshards;           /* number of lock shards */
 	apc_sma_t* sma;               /* shared memory allocator */
 	apc_serializer_t* serializer; /* serializer */
-	zend_long nslots;            /* number of slots in cache */
-	zend_long gc_ttl;            /* maximum time on GC list for a entry */
+	zend_long nslots;            /* initial number of slots in cache (all shards) */
+	zend_long gc_ttl;            /* time a worker may hold back the epoch before it is reported */
 	zend_long ttl;               /* if slot is needed and entry's access time is older than this ttl, remove it */
 	zend_long smart;             /* smart parameter for gc */
 	zend_bool defend;             /* defense parameter for runtime */
+	apc_cache_slam_key_t* slam_keys; /* table of keys recently inserted, by hash (stored in SHM) */
+	zend_ulong slam_mask;         /* slots of the slam defense table - 1 */
+	zend_bool optimistic_reads;   /* lookups walk the slots without taking the shard lock */
+	zend_bool pow2_slots;         /* tables have power of two sizes, and are indexed by mask */
+	zend_bool count_lookups;      /* count hits and misses */
+	zend_long atime_granularity;  /* access times are only written when they moved by more than this */
+	zend_long hits_sample;        /* hits of entries are counted 1 in hits_sample, by hits_sample */
+	zend_long eviction;           /* eviction policy, one of APC_CACHE_EVICT_* */
+	zend_long sweep_slots;        /* slots visited by apc_cache_sweep, 0 disables sweeping */
+	zend_long sweep_interval;     /* minimum seconds between sweeps */
+	zend_long entry_wait;         /* milliseconds apc_cache_entry waits for a value generated elsewhere */
+	zend_long ttl_jitter;         /* percent of their ttl entries may expire early by, at random */
 } apc_cache_t; /* }}} */
 
 /* {{{ typedef: apc_cache_updater_t */
@@ -110,12 +333,13 @@ typedef zend_bool (*apc_cache_updater_t)(apc_cache_t*, apc_cache_entry_t*, void*
  * PHP serializers, or search the list of serializers for the preferred serializer
  *
  * size_hint is a "hint" at the total number entries that will be expected.
- * It determines the physical size of the hash table. Passing 0 for
- * this argument will use a reasonable default value
+ * It determines the initial size of the hash table, which grows when more
+ * entries are stored. Passing 0 for this argument will use a reasonable default value
  *
- * gc_ttl is the maximum time a cache entry may speed on the garbage
- * collection list. This is basically a work around for the inherent
- * unreliability of our reference counting mechanism (see apc_cache_release).
+ * gc_ttl is the time after which workers still reading in an old epoch, and so
+ * holding back the reclamation of removed entries, are reported. They are still
+ * waited for, only the sections of processes which died are freed (see apc_cache_gc).
+ * 0 disables the report.
  *
  * ttl is the maximum time a cache entry can idle in a slot in case the slot
  * is needed.  This helps in cleaning up the cache and ensuring that entries
@@ -123,11 +347,28 @@ typedef zend_bool (*apc_cache_updater_t)(apc_cache_t*, apc_cache_entry_t*, void*
  *
  * for an explanation of smart, see apc_cache_default_expunge
  *
- * defend enables/disables slam defense for this particular cache
+ * defend is the number of keys slam defense remembers the last insert of for this
+ * particular cache, rounded up to a power of two, 0 disables slam defense
+ *
+ * nshards is the number of lock shards the slots are partitioned into,
+ * operations on a single key only lock the shard the key belongs to,
+ * operations on the whole cache lock every shard in order
+ *
+ * pow2_slots sizes the tables of slots to powers of two, the slot of a key is then
+ * selected by masking a mixed hash of the key rather than by a prime modulus
+ *
+ * admission enables the admission filter: the cache keeps a count-min sketch of the
+ * frequency of keys, and under memory pressure apc_cache_store rejects keys which are
+ * not more frequent than the entries eviction would remove to make room for them
+ *
+ * nreaders is the number of read sections which can be open at once, over all workers.
+ * Lookups which find every section taken read under the lock of the shard instead.
+ * Passing 0 uses APC_CACHE_READERS
  */
 PHP_APCU_API apc_cache_t* apc_cache_create(
         apc_sma_t* sma, apc_serializer_t* serializer, zend_long size_hint,
-        zend_long gc_ttl, zend_long ttl, zend_long smart, zend_bool defend);
+        zend_long gc_ttl, zend_long ttl, zend_long smart, zend_long defend,
+        zend_long nshards, zend_bool pow2_slots, zend_bool admission, zend_long nreaders);
 /*
 * apc_cache_preload preloads the data at path into the specified cache
 */
@@ -142,15 +383,48 @@ PHP_APCU_API void apc_cache_destroy(apc_cache_t* cache);
 
 /*
  * apc_cache_clear empties a cache. This can safely be called at any time.
+ * The tables of slots are swapped for empty ones, so reads and writes go on
+ * right away, the entries of the old tables are reclaimed later on.
  */
 PHP_APCU_API void apc_cache_clear(apc_cache_t* cache);
 
 /*
  * apc_cache_store creates key, entry and context in which to make an insertion of val into the specified cache
+ * Note: with the admission filter enabled, storing a new key may be rejected under memory pressure
  */
 PHP_APCU_API zend_bool apc_cache_store(
         apc_cache_t* cache, zend_string *key, const zval *val,
         const int32_t ttl, const zend_bool exclusive);
+
+/*
+ * apc_cache_store_ex is apc_cache_store, setting flags on the entry
+ * flags is a mask of APC_CACHE_ENTRY_* flags:
+ *  APC_CACHE_ENTRY_PINNED: the entry is never evicted to make room, nor removed by an
+ *   expunge or for idling longer than the ttl of the cache, its own ttl still applies
+ *  APC_CACHE_ENTRY_SLIDING: hits move the creation time of the entry, so that it only
+ *   expires once it was not hit for its ttl
+ * jitter is the percentage of the ttl the entry is shortened by at most, at random, so
+ * that entries stored together do not expire together. apc_cache_store uses the
+ * ttl_jitter of the cache
+ */
+PHP_APCU_API zend_bool apc_cache_store_ex(
+        apc_cache_t* cache, zend_string *key, const zval *val,
+        const int32_t ttl, const zend_bool exclusive, const uint32_t flags, const zend_long jitter);
+
+/*
+ * apc_cache_store_missing records key as known to be missing: the entry has the key and the
+ * ttl, but no value and no pool. Fetching the key fails, and reports it as missing.
+ * Any store to the key replaces it, including an exclusive one.
+ */
+PHP_APCU_API zend_bool apc_cache_store_missing(
+        apc_cache_t* cache, zend_string *key, const int32_t ttl);
+/*
+* apc_cache_touch starts the ttl of an entry over from now, with the ttl given,
+* without copying its value, 0 makes the entry never expire. Keys recorded by
+* apc_cache_store_missing are not touched, and return false like unknown keys
+*/
+PHP_APCU_API zend_bool apc_cache_touch(apc_cache_t *cache, zend_string *key, const int32_t ttl);
+
 /*
 * apc_cache_update updates an entry in place, this is used for inc/dec/cas
 */
@@ -161,7 +435,11 @@ PHP_APCU_API zend_bool apc_cache_update(
 /*
  * apc_cache_find searches for a cache entry by its hashed identifier,
  * and returns a pointer to the entry if found, NULL otherwise.
- *
+ * Entries of missing keys are returned too, see APC_CACHE_ENTRY_MISSING.
+ * The entry stays valid until it is passed to apc_cache_entry_release.
+ * A worker can hold up to APC_CACHE_HOLDS entries at once. Beyond that, or
+ * when every read section of the cache is taken, a warning is raised and
+ * NULL returned.
  */
 PHP_APCU_API apc_cache_entry_t* apc_cache_find(apc_cache_t* cache, zend_string *key, time_t t);
 
@@ -171,6 +449,12 @@ PHP_APCU_API apc_cache_entry_t* apc_cache_find(apc_cache_t* cache, zend_string *
  */
 PHP_APCU_API zend_bool apc_cache_fetch(apc_cache_t* cache, zend_string *key, time_t t, zval **dst);
 
+/*
+ * apc_cache_fetch_ex is apc_cache_fetch, setting missing when the fetch failed
+ * on an entry recorded by apc_cache_store_missing
+ */
+PHP_APCU_API zend_bool apc_cache_fetch_ex(apc_cache_t* cache, zend_string *key, time_t t, zval **dst, zend_bool *missing);
+
 /*
  * apc_cache_exists searches for a cache entry by its hashed identifier,
  * and returns whether the entry exists.
@@ -183,18 +467,19 @@ PHP_APCU_API zend_bool apc_cache_exists(apc_cache_t* cache, zend_string *key, ti
 PHP_APCU_API zend_bool apc_cache_delete(apc_cache_t* cache, zend_string *key);
 
 /* apc_cache_fetch_zval copies a cache entry value to be usable at runtime.
+ * Entries of missing keys have no value, dst is set to null and the fetch fails.
  */
 PHP_APCU_API zend_bool apc_cache_entry_fetch_zval(
 		apc_cache_t *cache, apc_cache_entry_t *entry, zval *dst);
 
 /*
- * apc_cache_entry_release decrements the reference count associated with a cache
- * entry. Calling apc_cache_find automatically increments the reference count,
- * and this function must be called post-execution to return the count to its
- * original value. Failing to do so will prevent the entry from being
- * garbage-collected.
+ * apc_cache_entry_release releases an entry returned by apc_cache_find.
+ * Every entry found by apc_cache_find is held in a read section of its own, which
+ * holds back the reclamation of removed entries, and this function must be called
+ * as soon as the caller is done with the entry to leave it.
+ * Sections still held are left at the end of the request.
  *
- * entry is the cache entry whose ref count you want to decrement.
+ * entry is the cache entry you want to release.
  */
 PHP_APCU_API void apc_cache_entry_release(apc_cache_t *cache, apc_cache_entry_t *entry);
 
@@ -208,6 +493,22 @@ PHP_APCU_API zend_bool apc_cache_info(zval *info, apc_cache_t *cache, zend_bool
 */
 PHP_APCU_API zval* apc_cache_stat(apc_cache_t* cache, zend_string *key, zval *stat);
 
+/*
+* apc_cache_sweep removes the expired entries from the next sweep_slots slots under the
+* sweep cursor, which is shared by every process, and moves the cursor past them.
+* Nothing is done when sweeping is disabled, or when the last sweep of any process was
+* less than sweep_interval seconds ago. Only the lock of the shard being swept is taken.
+* Before that, a few slots of the tables swapped out by apc_cache_clear are reclaimed.
+*/
+PHP_APCU_API void apc_cache_sweep(apc_cache_t* cache);
+
+/*
+* apc_cache_rlock_all and apc_cache_runlock_all read lock (and unlock) every shard of the cache,
+* for consumers walking the slots of the whole cache
+*/
+PHP_APCU_API void apc_cache_rlock_all(apc_cache_t* cache);
+PHP_APCU_API void apc_cache_runlock_all(apc_cache_t* cache);
+
 /*
 * apc_cache_busy returns true while the cache is busy
 *
@@ -223,7 +524,8 @@ PHP_APCU_API zend_bool apc_cache_busy(apc_cache_t* cache);
 /*
 * apc_cache_defense: guard against slamming a key
 *  will return true if the following conditions are met:
-*	the key provided has a matching hash and length to the last key inserted into cache
+*	the key provided has a matching hash and length to the last key inserted into its
+*   slot of the slam defense table, in the same second
 *   the last key has a different owner
 * in ZTS mode, TSRM determines owner
 * in non-ZTS mode, PID determines owner
@@ -270,15 +572,36 @@ PHP_APCU_API void apc_cache_serializer(apc_cache_t* cache, const char* name);
 *   2) If available memory if less than the size requested, run full expunge
 *
 * The TTL of an entry takes precedence over the TTL of a cache
+*
+* Where the eviction policy is APC_CACHE_EVICT_CLOCK, no full expunge is ever run:
+*   1) Perform cleanup of stale entries
+*   2) Move the clock hand over the slots, removing expired entries and entries
+*      which were not hit since the hand last passed, until the memory of the
+*      removed entries covers size (or size * smart where smart is set)
+*
+* Pinned entries (APC_CACHE_ENTRY_PINNED) are left alone by full expunges and by the
+* clock hand, only their own ttl expires them. apc_cache_clear removes them.
 */
 PHP_APCU_API void apc_cache_default_expunge(apc_cache_t* cache, size_t size);
 
 /*
 * apc_cache_entry: generate and create or fetch an entry
 *
+* The generator runs without holding any lock of the cache. The key is marked as being
+* generated meanwhile, and concurrent callers for the same key wait up to entry_wait
+* milliseconds for the value, before they run the generator themselves
+*
+* grace is the number of seconds the generated entry may still be returned once its
+* ttl has passed. While an entry is stale, the first caller runs the generator, and
+* every other caller gets the stale value rather than waiting for it
+*
+* beta enables early refreshes when greater than 0: the time the generator took is kept
+* with the entry, and a caller may get to refresh the entry before it expires, with a
+* probability growing as the expiry nears (XFetch). Larger values refresh earlier
+*
 * @see https://github.com/krakjoe/apcu/issues/142
 */
-PHP_APCU_API void apc_cache_entry(apc_cache_t *cache, zval *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc, zend_long ttl, zend_long now, zval *return_value);
+PHP_APCU_API void apc_cache_entry(apc_cache_t *cache, zval *key, zend_fcall_info *fci, zend_fcall_info_cache *fcc, zend_long ttl, zend_long grace, double beta, zend_long now, zval *return_value);
 
 #endif
 
@@ -45,6 +45,15 @@ ZEND_BEGIN_MODULE_GLOBALS(apcu)
 	zend_long gc_ttl;            /* parameter to apc_cache_create */
 	zend_long ttl;               /* parameter to apc_cache_create */
 	zend_long smart;             /* smart value */
+	char *eviction;              /* eviction policy, "expunge" or "clock" */
+	zend_bool admission;         /* parameter to apc_cache_create */
+	zend_long sweep_slots;       /* slots swept for expired entries at the end of a request */
+	zend_long sweep_interval;    /* seconds between sweeps */
+	zend_long entry_wait;        /* milliseconds apcu_entry() waits for a value generated elsewhere */
+	zend_long ttl_jitter;        /* percent of their ttl entries may expire early by */
+	zend_long lock_shards;       /* number of locks the user cache slots are striped over */
+	zend_long reader_slots;      /* parameter to apc_cache_create */
+	zend_bool pow2_slots;        /* power of two slot tables, indexed by mask */
 
 #if APC_MMAP
 	char *mmap_file_mask;   /* mktemp-style file-mask to pass to mmap */
@@ -54,16 +63,23 @@ ZEND_BEGIN_MODULE_GLOBALS(apcu)
 	zend_bool initialized;       /* true if module was initialized */
 	zend_bool enable_cli;        /* Flag to override turning APC off for CLI */
 	zend_bool slam_defense;      /* true for user cache slam defense */
+	zend_long slam_keys;         /* keys slam defense remembers the last insert of */
+	zend_bool optimistic_reads;  /* true to look up user cache entries without the lock */
+	zend_bool count_lookups;     /* true to count hits and misses of the user cache */
+	zend_long atime_granularity; /* seconds an access time must move by to be written */
+	zend_long hits_sample;       /* count 1 in hits_sample hits of an entry */
 
 	char *preload_path;          /* preload path */
 	zend_bool coredump_unmap;    /* trap signals that coredump and unmap shared memory */
 	zend_bool use_request_time;  /* use the SAPI request start time for TTL */
 	time_t request_time;         /* cached request time */
+	zend_ulong counter_slot;     /* selects the counter shard this worker counts into */
+	uint32_t sample_state;       /* state of the generator sampling hits */
+	apc_cache_hold_t holds[APC_CACHE_HOLDS]; /* sections kept open for entries returned by apc_cache_find */
+	int nholds;                  /* number of entries the worker holds */
 
 	char *serializer_name;       /* the serializer config option */
 	char *writable;              /* writable path for general use */
-
-	volatile zend_bool recursion;
 ZEND_END_MODULE_GLOBALS(apcu)
 
 /* (the following is defined in php_apc.c) */
@@ -55,12 +55,13 @@ static apc_iterator_item_t* apc_iterator_item_ctor(
 		apc_iterator_t *iterator, apc_cache_entry_t *entry) {
 	zval zv;
 	HashTable *ht;
+	apc_cache_entry_cold_t *cold = APC_CACHE_ENTRY_COLD(entry);
 	apc_iterator_item_t *item = ecalloc(1, sizeof(apc_iterator_item_t));
 
 	array_init(&item->value);
 	ht = Z_ARRVAL(item->value);
 
-	item->key = zend_string_dup(entry->key, 0);
+	item->key = zend_string_dup(&entry->key, 0);
 
 	if (APC_ITER_TYPE & iterator->format) {
 		ZVAL_STR_COPY(&zv, apc_str_user);
@@ -79,31 +80,32 @@ static apc_iterator_item_t* apc_iterator_item_ctor(
 	}
 
 	if (APC_ITER_NUM_HITS & iterator->format) {
-		ZVAL_LONG(&zv, entry->nhits);
+		ZVAL_LONG(&zv, cold->nhits);
 		zend_hash_add_new(ht, apc_str_num_hits, &zv);
 	}
 	if (APC_ITER_MTIME & iterator->format) {
-		ZVAL_LONG(&zv, entry->mtime);
+		ZVAL_LONG(&zv, APC_CACHE_ABS_TIME(apc_user_cache, cold->mtime));
 		zend_hash_add_new(ht, apc_str_mtime, &zv);
 	}
 	if (APC_ITER_CTIME & iterator->format) {
-		ZVAL_LONG(&zv, entry->ctime);
+		ZVAL_LONG(&zv, APC_CACHE_ABS_TIME(apc_user_cache, entry->ctime));
 		zend_hash_add_new(ht, apc_str_creation_time, &zv);
 	}
 	if (APC_ITER_DTIME & iterator->format) {
-		ZVAL_LONG(&zv, entry->dtime);
+		ZVAL_LONG(&zv, APC_CACHE_ABS_TIME(apc_user_cache, cold->dtime));
 		zend_hash_add_new(ht, apc_str_deletion_time, &zv);
 	}
 	if (APC_ITER_ATIME & iterator->format) {
-		ZVAL_LONG(&zv, entry->atime);
+		ZVAL_LONG(&zv, APC_CACHE_ABS_TIME(apc_user_cache, cold->atime));
 		zend_hash_add_new(ht, apc_str_access_time, &zv);
 	}
 	if (APC_ITER_REFCOUNT & iterator->format) {
-		ZVAL_LONG(&zv, entry->ref_count);
+		/* entries are not reference counted, readers hold an epoch instead */
+		ZVAL_LONG(&zv, 0);
 		zend_hash_add_new(ht, apc_str_ref_count, &zv);
 	}
 	if (APC_ITER_MEM_SIZE & iterator->format) {
-		ZVAL_LONG(&zv, entry->mem_size);
+		ZVAL_LONG(&zv, cold->mem_size);
 		zend_hash_add_new(ht, apc_str_mem_size, &zv);
 	}
 	if (APC_ITER_TTL & iterator->format) {
@@ -193,19 +195,19 @@ static int apc_iterator_search_match(apc_iterator_t *iterator, apc_cache_entry_t
 # if PHP_VERSION_ID >= 70300
 		rval = pcre2_match(
 			php_pcre_pce_re(iterator->pce),
-			(PCRE2_SPTR) ZSTR_VAL(entry->key), ZSTR_LEN(entry->key),
+			(PCRE2_SPTR) ZSTR_VAL(&entry->key), ZSTR_LEN(&entry->key),
 			0, 0, iterator->re_match_data, php_pcre_mctx()) >= 0;
 # else
 		rval = pcre_exec(
 			iterator->pce->re, iterator->pce->extra,
-			ZSTR_VAL(entry->key), ZSTR_LEN(entry->key),
+			ZSTR_VAL(&entry->key), ZSTR_LEN(&entry->key),
 			0, 0, NULL, 0) >= 0;
 # endif
 	}
 #endif
 
 	if (iterator->search_hash) {
-		rval = zend_hash_exists(iterator->search_hash, entry->key);
+		rval = zend_hash_exists(iterator->search_hash, &entry->key);
 	}
 
 	return rval;
@@ -216,7 +218,8 @@ static int apc_iterator_search_match(apc_iterator_t *iterator, apc_cache_entry_t
 static int apc_iterator_check_expiry(apc_cache_t* cache, apc_cache_entry_t *entry, time_t t)
 {
 	if (entry->ttl) {
-		if ((time_t) (entry->ctime + entry->ttl) < t) {
+		if ((time_t) (APC_CACHE_ABS_TIME(cache, entry->ctime) + entry->ttl) < t
+			&& (time_t) (APC_CACHE_ABS_TIME(cache, APC_CACHE_ENTRY_START(entry)) + entry->ttl) < t) {
 			return 0;
 		}
 	}
@@ -235,10 +238,19 @@ static int apc_iterator_fetch_active(apc_iterator_t *iterator) {
 		apc_iterator_item_dtor(apc_stack_pop(iterator->stack));
 	}
 
-	APC_RLOCK(apc_user_cache->header);
+	apc_cache_rlock_all(apc_user_cache);
 	php_apc_try {
-		while (count <= iterator->chunk_size && iterator->slot_idx < apc_user_cache->nslots) {
-			apc_cache_entry_t *entry = apc_user_cache->slots[iterator->slot_idx];
+		while (count <= iterator->chunk_size && iterator->shard_idx < apc_user_cache->nshards) {
+			apc_cache_shard_t *shard = APC_CACHE_SHARD(apc_user_cache, iterator->shard_idx);
+			apc_cache_entry_t *entry;
+
+			if (iterator->slot_idx >= APC_CACHE_SHARD_NSLOTS(shard)) {
+				iterator->shard_idx++;
+				iterator->slot_idx = 0;
+				continue;
+			}
+
+			entry = APC_CACHE_SHARD_BUCKET(shard, iterator->slot_idx)->head;
 			while (entry) {
 				if (apc_iterator_check_expiry(apc_user_cache, entry, t)) {
 					if (apc_iterator_search_match(iterator, entry)) {
@@ -255,7 +267,7 @@ static int apc_iterator_fetch_active(apc_iterator_t *iterator) {
 		}
 	} php_apc_finally {
 		iterator->stack_idx = 0;
-		APC_RUNLOCK(apc_user_cache->header)
+		apc_cache_runlock_all(apc_user_cache);
 	} php_apc_end_try();
 
 	return count;
@@ -298,26 +310,30 @@ static int apc_iterator_fetch_deleted(apc_iterator_t *iterator) {
 /* {{{ apc_iterator_totals */
 static void apc_iterator_totals(apc_iterator_t *iterator) {
 	time_t t = apc_time();
-	int i;
+	zend_long i, j;
 
-	APC_RLOCK(apc_user_cache->header);
+	apc_cache_rlock_all(apc_user_cache);
 	php_apc_try {
-		for (i=0; i < apc_user_cache->nslots; i++) {
-			apc_cache_entry_t *entry = apc_user_cache->slots[i];
-			while (entry) {
-				if (apc_iterator_check_expiry(apc_user_cache, entry, t)) {
-					if (apc_iterator_search_match(iterator, entry)) {
-						iterator->size += entry->mem_size;
-						iterator->hits += entry->nhits;
-						iterator->count++;
+		for (i=0; i < apc_user_cache->nshards; i++) {
+			apc_cache_shard_t *shard = APC_CACHE_SHARD(apc_user_cache, i);
+
+			for (j=0; j < APC_CACHE_SHARD_NSLOTS(shard); j++) {
+				apc_cache_entry_t *entry = APC_CACHE_SHARD_BUCKET(shard, j)->head;
+				while (entry) {
+					if (apc_iterator_check_expiry(apc_user_cache, entry, t)) {
+						if (apc_iterator_search_match(iterator, entry)) {
+							iterator->size += APC_CACHE_ENTRY_COLD(entry)->mem_size;
+							iterator->hits += APC_CACHE_ENTRY_COLD(entry)->nhits;
+							iterator->count++;
+						}
 					}
+					entry = entry->next;
 				}
-				entry = entry->next;
 			}
 		}
 	} php_apc_finally {
 		iterator->totals_flag = 1;
-		APC_RUNLOCK(apc_user_cache->header);
+		apc_cache_runlock_all(apc_user_cache);
 	} php_apc_end_try();
 }
 /* }}} */
@@ -348,6 +364,7 @@ void apc_iterator_obj_init(apc_iterator_t *iterator, zval *search, zend_long for
 	}
 
 	iterator->slot_idx = 0;
+	iterator->shard_idx = 0;
 	iterator->stack_idx = 0;
 	iterator->key_idx = 0;
 	iterator->chunk_size = chunk_size == 0 ? APC_DEFAULT_CHUNK_SIZE : chunk_size;
@@ -412,6 +429,7 @@ PHP_METHOD(apc_iterator, rewind) {
 	}
 
 	iterator->slot_idx = 0;
+	iterator->shard_idx = 0;
 	iterator->stack_idx = 0;
 	iterator->key_idx = 0;
 	iterator->fetch(iterator);
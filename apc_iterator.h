@@ -59,6 +59,7 @@ typedef struct _apc_iterator_t {
 	int (*fetch)(struct _apc_iterator_t *iterator);
 							 /* fetch callback to fetch items from cache slots or lists */
 	zend_long slot_idx;           /* index to the slot array or linked list */
+	zend_long shard_idx;          /* index to the cache shard being iterated */
 	zend_long chunk_size;         /* number of entries to pull down per fetch */
 	apc_stack_t *stack;      /* stack of entries pulled from cache */
 	int stack_idx;           /* index into the current stack */
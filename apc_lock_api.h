@@ -103,13 +103,27 @@ PHP_APCU_API void apc_lock_destroy(apc_lock_t *lock); /* }}} */
 # ifdef _WIN64
 #  define ATOMIC_INC(a) InterlockedIncrement64(&a)
 #  define ATOMIC_DEC(a) InterlockedDecrement64(&a)
+#  define ATOMIC_ADD(a, b) (InterlockedExchangeAdd64(&a, b) + (b))
+#  define ATOMIC_SUB(a, b) (InterlockedExchangeAdd64(&a, -(b)) - (b))
 # else
 #  define ATOMIC_INC(a) InterlockedIncrement(&a)
 #  define ATOMIC_DEC(a) InterlockedDecrement(&a)
+#  define ATOMIC_ADD(a, b) (InterlockedExchangeAdd(&a, b) + (b))
+#  define ATOMIC_SUB(a, b) (InterlockedExchangeAdd(&a, -(b)) - (b))
 # endif
+# define ATOMIC_CAS32(a, o, n) \
+	(InterlockedCompareExchange((LONG volatile *) &a, (LONG) (n), (LONG) (o)) == (LONG) (o))
+# define ATOMIC_CASPTR(a, o, n) \
+	(InterlockedCompareExchangePointer((PVOID volatile *) &a, (PVOID) (n), (PVOID) (o)) == (PVOID) (o))
+# define APC_MEMORY_BARRIER() MemoryBarrier()
 #else
 # define ATOMIC_INC(a) __sync_add_and_fetch(&a, 1)
 # define ATOMIC_DEC(a) __sync_sub_and_fetch(&a, 1)
+# define ATOMIC_ADD(a, b) __sync_add_and_fetch(&a, b)
+# define ATOMIC_SUB(a, b) __sync_sub_and_fetch(&a, b)
+# define ATOMIC_CAS32(a, o, n) __sync_bool_compare_and_swap(&a, o, n)
+# define ATOMIC_CASPTR(a, o, n) __sync_bool_compare_and_swap(&a, o, n)
+# define APC_MEMORY_BARRIER() __sync_synchronize()
 #endif
 
 #endif
@@ -55,6 +55,7 @@ typedef struct _pool_block
 	size_t              avail;
 	unsigned char       *mark;
 	struct _pool_block  *next;
+	zend_bool           slab; /* allocated by slab_malloc */
 	unsigned             :0; /* this should align to word */
 	/* data comes here */
 } pool_block;
@@ -67,6 +68,8 @@ struct _apc_pool {
 
 	unsigned long count;
 
+	zend_bool slab; /* allocated by slab_malloc */
+
 	pool_block *head;
 	pool_block first;
 };
@@ -95,24 +98,45 @@ static const unsigned char decaff[] =  {
 
 /* }}} */
 
-#define INIT_POOL_BLOCK(rpool, entry, size) do {\
+#define INIT_POOL_BLOCK(rpool, entry, size, from_slab) do {\
 	(entry)->avail = (size);\
+	(entry)->slab = (from_slab);\
 	(entry)->mark = ((unsigned char*)(entry)) + ALIGNWORD(sizeof(pool_block));\
 	(entry)->next = (rpool)->head;\
 	(rpool)->head = (entry);\
 } while(0)
 
+/* {{{ pool_malloc: allocates small blocks from a slab, and the rest from the sma */
+static void* pool_malloc(apc_sma_t *sma, size_t size, size_t *allocated, zend_bool *slab)
+{
+	zend_ulong chunk;
+	void *p = sma->slab_malloc(size, &chunk);
+
+	if (p) {
+		/* the chunk is rounded up to its size class, the rest is usable too */
+		*allocated = chunk;
+		*slab = 1;
+		return p;
+	}
+
+	*allocated = size;
+	*slab = 0;
+	return sma->smalloc(size);
+}
+/* }}} */
+
 /* {{{ create_pool_block */
 static pool_block* create_pool_block(apc_pool *pool, apc_sma_t *sma, size_t size)
 {
 	size_t realsize = sizeof(pool_block) + ALIGNWORD(size);
+	zend_bool slab;
 
-	pool_block* entry = sma->smalloc(realsize);
+	pool_block* entry = pool_malloc(sma, realsize, &realsize, &slab);
 	if (!entry) {
 		return NULL;
 	}
 
-	INIT_POOL_BLOCK(pool, entry, size);
+	INIT_POOL_BLOCK(pool, entry, realsize - sizeof(pool_block), slab);
 
 	pool->size += realsize;
 	pool->count++;
@@ -267,11 +291,19 @@ PHP_APCU_API void apc_pool_destroy(apc_pool *pool, apc_sma_t *sma)
 	entry = pool->head;
 	while (entry->next != NULL) {
 		pool_block *tmp = entry->next;
-		sma->sfree(entry);
+		if (entry->slab) {
+			sma->slab_free(entry);
+		} else {
+			sma->sfree(entry);
+		}
 		entry = tmp;
 	}
 
-	sma->sfree(pool);
+	if (pool->slab) {
+		sma->slab_free(pool);
+	} else {
+		sma->sfree(pool);
+	}
 }
 /* }}} */
 
@@ -280,6 +312,8 @@ PHP_APCU_API void apc_pool_destroy(apc_pool *pool, apc_sma_t *sma)
 PHP_APCU_API apc_pool* apc_pool_create(apc_pool_type type, apc_sma_t *sma)
 {
 	size_t dsize = 0;
+	size_t size;
+	zend_bool slab;
 	apc_pool *pool;
 
 	switch (type) {
@@ -299,17 +333,18 @@ PHP_APCU_API apc_pool* apc_pool_create(apc_pool_type type, apc_sma_t *sma)
 			return NULL;
 	}
 
-	pool = sma->smalloc((sizeof(apc_pool) + ALIGNWORD(dsize)));
+	pool = pool_malloc(sma, sizeof(apc_pool) + ALIGNWORD(dsize), &size, &slab);
 	if (!pool) {
 		return NULL;
 	}
 
-	pool->size = sizeof(apc_pool) + ALIGNWORD(dsize);
+	pool->size = size;
 	pool->dsize = dsize;
+	pool->slab = slab;
 	pool->head = NULL;
 	pool->count = 0;
 
-	INIT_POOL_BLOCK(pool, &(pool->first), dsize);
+	INIT_POOL_BLOCK(pool, &(pool->first), size - sizeof(apc_pool), 0);
 
 	return pool;
 }
@@ -47,13 +47,6 @@ enum {
 	DEFAULT_NUMSEG=1,
 	DEFAULT_SEGSIZE=30*1024*1024 };
 
-typedef struct sma_header_t sma_header_t;
-struct sma_header_t {
-	apc_lock_t sma_lock;    /* segment lock */
-	size_t segsize;         /* size of entire segment */
-	size_t avail;           /* bytes available (not necessarily contiguous) */
-};
-
 #define SMA_HDR(sma, i)  ((sma_header_t*)((sma->segs[i]).shmaddr))
 #define SMA_ADDR(sma, i) ((char*)(SMA_HDR(sma, i)))
 #define SMA_RO(sma, i)   ((char*)(sma->segs[i]).roaddr)
@@ -81,12 +74,47 @@ struct block_t {
 #endif
 };
 
+/* {{{ SMA_CLASSES: free blocks are kept on one list per power of two size class */
+#define SMA_CLASSES (sizeof(size_t) * CHAR_BIT)
+/* }}} */
+
+/* {{{ slabs: small blocks are chunks of fixed size classes, carved in batches from SMA_SLAB_SIZE blocks */
+#define SMA_SLAB_SIZE    (32 * 1024)
+#define SMA_SLAB_QUANTUM 128    /* chunk sizes are multiples of the quantum */
+#define SMA_SLAB_CLASSES 8      /* up to SMA_SLAB_QUANTUM * SMA_SLAB_CLASSES bytes */
+#define SMA_SLAB_BITS    (sizeof(size_t) * CHAR_BIT)
+#define SMA_SLAB_WORDS   ((SMA_SLAB_SIZE / SMA_SLAB_QUANTUM + SMA_SLAB_BITS - 1) / SMA_SLAB_BITS)
+#define SMA_SLAB_CHUNK   ALIGNWORD(sizeof(size_t)) /* chunk header, the offset of the chunk in its slab */
+/* }}} */
+
+typedef struct slab_t slab_t;
+struct slab_t {
+	size_t fnext;      /* offset in segment of next slab with free chunks */
+	size_t fprev;      /* offset in segment of prev slab with free chunks */
+	size_t size;       /* size of the chunks in this slab, including their header */
+	size_t count;      /* number of chunks in this slab */
+	size_t used;       /* number of chunks allocated */
+	size_t map[SMA_SLAB_WORDS]; /* bit set for each free chunk */
+};
+
+typedef struct sma_header_t sma_header_t;
+struct sma_header_t {
+	apc_lock_t sma_lock;    /* segment lock */
+	size_t segsize;         /* size of entire segment */
+	size_t avail;           /* bytes available (not necessarily contiguous) */
+	size_t slab_avail;      /* bytes of free chunks in slabs, available to small allocations only */
+	size_t classes;         /* bitmap of the size classes with free blocks */
+	block_t lists[SMA_CLASSES]; /* sentinels of the circular free lists, one per size class */
+	slab_t slabs[SMA_SLAB_CLASSES]; /* sentinels of the circular lists of slabs with free chunks */
+};
+
 /* The macros BLOCKAT and OFFSET are used for convenience throughout this
  * module. Both assume the presence of a variable shmaddr that points to the
  * beginning of the shared memory segment in question. */
 
 #define BLOCKAT(offset) ((block_t*)((char *)shmaddr + offset))
 #define OFFSET(block) ((size_t)(((char*)block) - (char*)shmaddr))
+#define SLABAT(offset) ((slab_t*)((char *)shmaddr + offset))
 
 /* macros for getting the next or previous sequential block */
 #define NEXT_SBLOCK(block) ((block_t*)((char*)block + block->size))
@@ -107,13 +135,66 @@ struct block_t {
 #define MINBLOCKSIZE (ALIGNWORD(1) + ALIGNWORD(sizeof(block_t)))
 /* }}} */
 
+/* {{{ sma_log2: index of the highest bit set in a non-zero value */
+static inline unsigned int sma_log2(size_t value)
+{
+	unsigned int bit = 0, shift;
+
+	for (shift = SMA_CLASSES / 2; shift; shift >>= 1) {
+		if (value >> shift) {
+			value >>= shift;
+			bit += shift;
+		}
+	}
+
+	return bit;
+}
+/* }}} */
+
+/* {{{ sma_list: sentinel of the free list for blocks of the given size */
+static inline block_t* sma_list(sma_header_t* header, size_t size)
+{
+	return &header->lists[sma_log2(size)];
+}
+/* }}} */
+
+/* {{{ sma_link: puts a free block at the head of the list for its size class */
+static inline void sma_link(sma_header_t* header, block_t* block)
+{
+	void* shmaddr = header;
+	block_t* list = sma_list(header, block->size);
+
+	block->fnext = list->fnext;
+	block->fprev = OFFSET(list);
+	BLOCKAT(list->fnext)->fprev = OFFSET(block);
+	list->fnext = OFFSET(block);
+
+	header->classes |= ((size_t) 1) << sma_log2(block->size);
+}
+/* }}} */
+
+/* {{{ sma_unlink: takes a free block off its list, block->size must not have changed since it was linked */
+static inline void sma_unlink(sma_header_t* header, block_t* block)
+{
+	void* shmaddr = header;
+	block_t* list;
+
+	BLOCKAT(block->fnext)->fprev = block->fprev;
+	BLOCKAT(block->fprev)->fnext = block->fnext;
+
+	list = sma_list(header, block->size);
+	if (list->fnext == OFFSET(list)) {
+		header->classes &= ~(((size_t) 1) << sma_log2(block->size));
+	}
+}
+/* }}} */
+
 /* {{{ sma_allocate: tries to allocate at least size bytes in a segment */
 static APC_HOTSPOT size_t sma_allocate(sma_header_t* header, zend_ulong size, zend_ulong fragment, zend_ulong *allocated)
 {
 	void* shmaddr;          /* header of shared memory segment */
-	block_t* prv;           /* block prior to working block */
-	block_t* cur;           /* working block in list */
-	block_t* prvnextfit;    /* block before next fit */
+	block_t* cur;           /* block to allocate from */
+	unsigned int cls;       /* size class of realsize */
 	size_t realsize;        /* actual size of block needed, including header */
 	const size_t block_size = ALIGNWORD(sizeof(struct block_t));
 
@@ -129,42 +210,49 @@ static APC_HOTSPOT size_t sma_allocate(sma_header_t* header, zend_ulong size, ze
 		return -1;
 	}
 
-	prvnextfit = 0;     /* initially null (no fit) */
-	prv = BLOCKAT(ALIGNWORD(sizeof(sma_header_t)));
+	/*
+	 * Any block in a class above the one realsize falls in is large enough,
+	 * so the head of the smallest such class is taken without a search.
+	 * Only when there is none is the class of realsize itself searched,
+	 * as it holds blocks both smaller and larger than realsize.
+	 */
+	cls = sma_log2(realsize);
+	cur = NULL;
 
-	CHECK_CANARY(prv);
+	if (cls + 1 < SMA_CLASSES && (header->classes >> (cls + 1))) {
+		size_t above = (header->classes >> (cls + 1)) << (cls + 1);
+		block_t* list = &header->lists[sma_log2(above & (~above + 1))];
 
-	while (prv->fnext != 0) {
-		cur = BLOCKAT(prv->fnext);
+		cur = BLOCKAT(list->fnext);
+	} else if (header->classes & (((size_t) 1) << cls)) {
+		block_t* list = &header->lists[cls];
+		size_t next;
 
-		CHECK_CANARY(cur);
+		for (next = list->fnext; next != OFFSET(list); next = BLOCKAT(next)->fnext) {
+			CHECK_CANARY(BLOCKAT(next));
 
-		/* If it can fit realsize bytes in cur block, stop searching */
-		if (cur->size >= realsize) {
-			prvnextfit = prv;
-			break;
+			/* If it can fit realsize bytes in this block, stop searching */
+			if (BLOCKAT(next)->size >= realsize) {
+				cur = BLOCKAT(next);
+				break;
+			}
 		}
-		prv = cur;
 	}
 
-	if (prvnextfit == 0) {
+	if (cur == NULL) {
 		return -1;
 	}
 
-	prv = prvnextfit;
-	cur = BLOCKAT(prv->fnext);
-
-	CHECK_CANARY(prv);
 	CHECK_CANARY(cur);
 
+	sma_unlink(header, cur);
+
 	if (cur->size == realsize || (cur->size > realsize && cur->size < (realsize + (MINBLOCKSIZE + fragment)))) {
-		/* cur is big enough for realsize, but too small to split - unlink it */
+		/* cur is big enough for realsize, but too small to split - use all of it */
 		*(allocated) = cur->size - block_size;
-		prv->fnext = cur->fnext;
-		BLOCKAT(cur->fnext)->fprev = OFFSET(prv);
 		NEXT_SBLOCK(cur)->prev_size = 0;  /* block is alloc'd */
 	} else {
-		/* nextfit is too big; split it into two smaller blocks */
+		/* cur is too big; split it into two smaller blocks */
 		block_t* nxt;      /* the new block (chopped part of cur) */
 		size_t oldsize;    /* size of cur before split */
 
@@ -177,11 +265,8 @@ static APC_HOTSPOT size_t sma_allocate(sma_header_t* header, zend_ulong size, ze
 		NEXT_SBLOCK(nxt)->prev_size = nxt->size;  /* adjust size */
 		SET_CANARY(nxt);
 
-		/* replace cur with next in free list */
-		nxt->fnext = cur->fnext;
-		nxt->fprev = cur->fprev;
-		BLOCKAT(nxt->fnext)->fprev = OFFSET(nxt);
-		BLOCKAT(nxt->fprev)->fnext = OFFSET(nxt);
+		/* the rest goes on the list for its own size class */
+		sma_link(header, nxt);
 #if 0
 		nxt->id = -1;
 #endif
@@ -226,8 +311,7 @@ static APC_HOTSPOT size_t sma_deallocate(void* shmaddr, size_t offset)
 	if (cur->prev_size != 0) {
 		/* remove prv from list */
 		prv = PREV_SBLOCK(cur);
-		BLOCKAT(prv->fnext)->fprev = prv->fprev;
-		BLOCKAT(prv->fprev)->fnext = prv->fnext;
+		sma_unlink(header, prv);
 		/* cur and prv share an edge, combine them */
 		prv->size +=cur->size;
 
@@ -239,8 +323,7 @@ static APC_HOTSPOT size_t sma_deallocate(void* shmaddr, size_t offset)
 	if (nxt->fnext != 0) {
 		assert(NEXT_SBLOCK(NEXT_SBLOCK(cur))->prev_size == nxt->size);
 		/* cur and nxt shared an edge, combine them */
-		BLOCKAT(nxt->fnext)->fprev = nxt->fprev;
-		BLOCKAT(nxt->fprev)->fnext = nxt->fnext;
+		sma_unlink(header, nxt);
 		cur->size += nxt->size;
 
 		CHECK_CANARY(nxt);
@@ -254,17 +337,108 @@ static APC_HOTSPOT size_t sma_deallocate(void* shmaddr, size_t offset)
 
 	NEXT_SBLOCK(cur)->prev_size = cur->size;
 
-	/* insert new block after prv */
-	prv = BLOCKAT(ALIGNWORD(sizeof(sma_header_t)));
-	cur->fnext = prv->fnext;
-	prv->fnext = OFFSET(cur);
-	cur->fprev = OFFSET(prv);
-	BLOCKAT(cur->fnext)->fprev = OFFSET(cur);
+	/* insert new block at the head of its size class */
+	sma_link(header, cur);
 
 	return size;
 }
 /* }}} */
 
+/* {{{ sma_slab_allocate: takes a chunk for size bytes from a slab, carving a new slab when none has a free chunk */
+static APC_HOTSPOT size_t sma_slab_allocate(sma_header_t* header, zend_ulong size, zend_ulong *allocated)
+{
+	void* shmaddr = header;
+	slab_t* list = &header->slabs[(size + SMA_SLAB_CHUNK - 1) / SMA_SLAB_QUANTUM];
+	slab_t* slab;
+	size_t word, bit, chunk;
+
+	if (list->fnext == OFFSET(list)) {
+		zend_ulong carved;
+		size_t off = sma_allocate(header, SMA_SLAB_SIZE, MINBLOCKSIZE, &carved);
+
+		if (off == -1) {
+			return -1;
+		}
+
+		slab = SLABAT(off);
+		slab->size = (list - header->slabs + 1) * SMA_SLAB_QUANTUM;
+		slab->count = (carved - ALIGNWORD(sizeof(slab_t))) / slab->size;
+		if (slab->count > SMA_SLAB_WORDS * SMA_SLAB_BITS) {
+			slab->count = SMA_SLAB_WORDS * SMA_SLAB_BITS;
+		}
+		slab->used = 0;
+
+		memset(slab->map, 0, sizeof(slab->map));
+		for (bit = 0; bit < slab->count; bit++) {
+			slab->map[bit / SMA_SLAB_BITS] |= ((size_t) 1) << (bit % SMA_SLAB_BITS);
+		}
+
+		slab->fnext = list->fnext;
+		slab->fprev = OFFSET(list);
+		SLABAT(list->fnext)->fprev = OFFSET(slab);
+		list->fnext = OFFSET(slab);
+
+		header->slab_avail += slab->count * slab->size;
+	}
+
+	slab = SLABAT(list->fnext);
+
+	for (word = 0; !slab->map[word]; word++);
+
+	bit = sma_log2(slab->map[word] & (~slab->map[word] + 1));
+	slab->map[word] &= ~(((size_t) 1) << bit);
+
+	/* full slabs are off the list until one of their chunks is freed */
+	if (++slab->used == slab->count) {
+		SLABAT(slab->fnext)->fprev = slab->fprev;
+		SLABAT(slab->fprev)->fnext = slab->fnext;
+	}
+
+	header->slab_avail -= slab->size;
+
+	chunk = OFFSET(slab) + ALIGNWORD(sizeof(slab_t)) + (word * SMA_SLAB_BITS + bit) * slab->size;
+	*(size_t*) SLABAT(chunk) = chunk - OFFSET(slab);
+	*(allocated) = slab->size - SMA_SLAB_CHUNK;
+
+	return chunk + SMA_SLAB_CHUNK;
+}
+/* }}} */
+
+/* {{{ sma_slab_deallocate: returns the chunk at the given offset to its slab */
+static APC_HOTSPOT void sma_slab_deallocate(void* shmaddr, size_t offset)
+{
+	sma_header_t* header = (sma_header_t*) shmaddr;
+	slab_t* list;
+	slab_t* slab;
+	size_t index;
+
+	offset -= SMA_SLAB_CHUNK;
+
+	slab = SLABAT(offset - *(size_t*) SLABAT(offset));
+	list = &header->slabs[slab->size / SMA_SLAB_QUANTUM - 1];
+	index = (offset - OFFSET(slab) - ALIGNWORD(sizeof(slab_t))) / slab->size;
+
+	assert(!(slab->map[index / SMA_SLAB_BITS] & (((size_t) 1) << (index % SMA_SLAB_BITS))));
+	slab->map[index / SMA_SLAB_BITS] |= ((size_t) 1) << (index % SMA_SLAB_BITS);
+	header->slab_avail += slab->size;
+
+	if (slab->used-- == slab->count) {
+		slab->fnext = list->fnext;
+		slab->fprev = OFFSET(list);
+		SLABAT(list->fnext)->fprev = OFFSET(slab);
+		list->fnext = OFFSET(slab);
+	}
+
+	/* empty slabs go back to the segment, but the last one of a class is kept for the next allocation */
+	if (slab->used == 0 && (slab->fnext != OFFSET(list) || slab->fprev != OFFSET(list))) {
+		SLABAT(slab->fnext)->fprev = slab->fprev;
+		SLABAT(slab->fprev)->fnext = slab->fnext;
+		header->slab_avail -= slab->count * slab->size;
+		sma_deallocate(shmaddr, OFFSET(slab));
+	}
+}
+/* }}} */
+
 /* {{{ APC SMA API */
 PHP_APCU_API void apc_sma_api_init(apc_sma_t* sma, void** data, apc_sma_expunge_f expunge, int32_t num, zend_ulong size, char *mask) {
 	uint i;
@@ -301,6 +475,7 @@ PHP_APCU_API void apc_sma_api_init(apc_sma_t* sma, void** data, apc_sma_expunge_
 		sma_header_t*   header;
 		block_t     *first, *empty, *last;
 		void*       shmaddr;
+		uint        j;
 
 #if APC_MMAP
 		sma->segs[i] = apc_mmap(mask, sma->size);
@@ -308,12 +483,12 @@ PHP_APCU_API void apc_sma_api_init(apc_sma_t* sma, void** data, apc_sma_expunge_
 			memcpy(&mask[strlen(mask)-6], "XXXXXX", 6);
 #else
 		{
-			int j = apc_shm_create(i, sma->size);
+			int id = apc_shm_create(i, sma->size);
 #if PHP_WIN32
 			/* TODO remove the line below after 7.1 EOL. */
 			SetLastError(0);
 #endif
-			sma->segs[i] = apc_shm_attach(j, sma->size);
+			sma->segs[i] = apc_shm_attach(id, sma->size);
 		}
 #endif
 
@@ -325,29 +500,49 @@ PHP_APCU_API void apc_sma_api_init(apc_sma_t* sma, void** data, apc_sma_expunge_
 		CREATE_LOCK(&header->sma_lock);
 		header->segsize = sma->size;
 		header->avail = sma->size - ALIGNWORD(sizeof(sma_header_t)) - ALIGNWORD(sizeof(block_t)) - ALIGNWORD(sizeof(block_t));
+		header->classes = 0;
+		header->slab_avail = 0;
+
+		for (j = 0; j < SMA_CLASSES; j++) {
+			block_t* list = &header->lists[j];
+
+			list->size = 0;
+			list->prev_size = 0;
+			list->fnext = OFFSET(list);
+			list->fprev = OFFSET(list);
+			SET_CANARY(list);
+		}
+
+		for (j = 0; j < SMA_SLAB_CLASSES; j++) {
+			slab_t* list = &header->slabs[j];
 
+			memset(list, 0, sizeof(slab_t));
+			list->fnext = OFFSET(list);
+			list->fprev = OFFSET(list);
+		}
+
+		/* first and last only bound the segment, they are never on a list */
 		first = BLOCKAT(ALIGNWORD(sizeof(sma_header_t)));
 		first->size = 0;
-		first->fnext = ALIGNWORD(sizeof(sma_header_t)) + ALIGNWORD(sizeof(block_t));
+		first->fnext = 0;
 		first->fprev = 0;
 		first->prev_size = 0;
 		SET_CANARY(first);
 #if 0
 		first->id = -1;
 #endif
-		empty = BLOCKAT(first->fnext);
+		empty = BLOCKAT(ALIGNWORD(sizeof(sma_header_t)) + ALIGNWORD(sizeof(block_t)));
 		empty->size = header->avail - ALIGNWORD(sizeof(block_t));
-		empty->fnext = OFFSET(empty) + empty->size;
-		empty->fprev = ALIGNWORD(sizeof(sma_header_t));
 		empty->prev_size = 0;
 		SET_CANARY(empty);
+		sma_link(header, empty);
 #if 0
 		empty->id = -1;
 #endif
-		last = BLOCKAT(empty->fnext);
+		last = BLOCKAT(OFFSET(empty) + empty->size);
 		last->size = 0;
 		last->fnext = 0;
-		last->fprev =  OFFSET(empty);
+		last->fprev = 0;
 		last->prev_size = empty->size;
 		SET_CANARY(last);
 #if 0
@@ -495,6 +690,69 @@ PHP_APCU_API void apc_sma_api_free(apc_sma_t* sma, void* p) {
 	apc_error("apc_sma_free: could not locate address %p", p);
 }
 
+PHP_APCU_API void* apc_sma_api_slab_malloc(apc_sma_t* sma, zend_ulong n, zend_ulong* allocated) {
+	size_t off;
+	int32_t i, j;
+
+	assert(sma->initialized);
+
+	if (n + SMA_SLAB_CHUNK > SMA_SLAB_QUANTUM * SMA_SLAB_CLASSES) {
+		return NULL;
+	}
+
+	/* slabs are not worth an expunge, failing here leaves that to apc_sma_api_malloc */
+	for (j = 0; j < sma->num; j++) {
+		i = (sma->last + j) % sma->num;
+
+		if (!WLOCK(&SMA_LCK(sma, i))) {
+			return NULL;
+		}
+
+		off = sma_slab_allocate(SMA_HDR(sma, i), n, allocated);
+		WUNLOCK(&SMA_LCK(sma, i));
+
+		if (off != -1) {
+			void* p = (void *)(SMA_ADDR(sma, i) + off);
+			sma->last = i;
+#ifdef VALGRIND_MALLOCLIKE_BLOCK
+			VALGRIND_MALLOCLIKE_BLOCK(p, n, 0, 0);
+#endif
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+PHP_APCU_API void apc_sma_api_slab_free(apc_sma_t* sma, void* p) {
+	uint i;
+	size_t offset;
+
+	if (p == NULL) {
+		return;
+	}
+
+	assert(sma->initialized);
+
+	for (i = 0; i < sma->num; i++) {
+		offset = (size_t)((char *)p - SMA_ADDR(sma, i));
+		if (p >= (void*)SMA_ADDR(sma, i) && offset < sma->size) {
+			if (!WLOCK(&SMA_LCK(sma, i))) {
+				return;
+			}
+
+			sma_slab_deallocate(SMA_HDR(sma, i), offset);
+			WUNLOCK(&SMA_LCK(sma, i));
+#ifdef VALGRIND_FREELIKE_BLOCK
+			VALGRIND_FREELIKE_BLOCK(p, 0);
+#endif
+			return;
+		}
+	}
+
+	apc_error("apc_sma_slab_free: could not locate address %p", p);
+}
+
 #ifdef APC_MEMPROTECT
 PHP_APCU_API void* apc_sma_api_protect(apc_sma_t* sma, void* p) {
 	unsigned int i = 0;
@@ -557,7 +815,7 @@ PHP_APCU_API apc_sma_info_t* apc_sma_api_info(apc_sma_t* sma, zend_bool limited)
 	apc_sma_link_t** link;
 	uint i;
 	char* shmaddr;
-	block_t* prv;
+	uint j;
 
 	if (!sma->initialized) {
 		return NULL;
@@ -580,23 +838,41 @@ PHP_APCU_API apc_sma_info_t* apc_sma_api_info(apc_sma_t* sma, zend_bool limited)
 	for (i = 0; i < sma->num; i++) {
 		RLOCK(&SMA_LCK(sma, i));
 		shmaddr = SMA_ADDR(sma, i);
-		prv = BLOCKAT(ALIGNWORD(sizeof(sma_header_t)));
 
 		link = &info->list[i];
 
-		/* For each block in this segment */
-		while (BLOCKAT(prv->fnext)->fnext != 0) {
-			block_t* cur = BLOCKAT(prv->fnext);
+		/* For each free block in this segment, by size class */
+		for (j = 0; j < SMA_CLASSES; j++) {
+			block_t* list = &SMA_HDR(sma, i)->lists[j];
+			size_t next;
 
-			CHECK_CANARY(cur);
+			for (next = list->fnext; next != OFFSET(list); next = BLOCKAT(next)->fnext) {
+				block_t* cur = BLOCKAT(next);
 
-			*link = apc_emalloc(sizeof(apc_sma_link_t));
-			(*link)->size = cur->size;
-			(*link)->offset = prv->fnext;
-			(*link)->next = NULL;
-			link = &(*link)->next;
+				CHECK_CANARY(cur);
 
-			prv = cur;
+				*link = apc_emalloc(sizeof(apc_sma_link_t));
+				(*link)->size = cur->size;
+				(*link)->offset = next;
+				(*link)->next = NULL;
+				link = &(*link)->next;
+			}
+		}
+
+		/* For each slab with free chunks, by chunk size */
+		for (j = 0; j < SMA_SLAB_CLASSES; j++) {
+			slab_t* list = &SMA_HDR(sma, i)->slabs[j];
+			size_t next;
+
+			for (next = list->fnext; next != OFFSET(list); next = SLABAT(next)->fnext) {
+				slab_t* cur = SLABAT(next);
+
+				*link = apc_emalloc(sizeof(apc_sma_link_t));
+				(*link)->size = (cur->count - cur->used) * cur->size;
+				(*link)->offset = next;
+				(*link)->next = NULL;
+				link = &(*link)->next;
+			}
 		}
 		RUNLOCK(&SMA_LCK(sma, i));
 	}
@@ -625,7 +901,7 @@ PHP_APCU_API zend_ulong apc_sma_api_get_avail_mem(apc_sma_t* sma) {
 
 	for (i = 0; i < sma->num; i++) {
 		sma_header_t* header = SMA_HDR(sma, i);
-		avail_mem += header->avail;
+		avail_mem += header->avail + header->slab_avail;
 	}
 	return avail_mem;
 }
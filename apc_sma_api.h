@@ -72,6 +72,7 @@ typedef void (*apc_sma_free_info_f) (apc_sma_info_t *info);
 typedef zend_ulong (*apc_sma_get_avail_mem_f) (void);
 typedef zend_bool (*apc_sma_get_avail_size_f) (zend_ulong size);
 typedef void (*apc_sma_check_integrity_f) (void);
+typedef void* (*apc_sma_slab_malloc_f) (zend_ulong size, zend_ulong *allocated);
 typedef void (*apc_sma_expunge_f)(void* pointer, zend_ulong size); /* }}} */
 
 /* {{{ struct definition: apc_sma_t */
@@ -92,6 +93,8 @@ typedef struct _apc_sma_t {
 	apc_sma_get_avail_mem_f get_avail_mem;       /* get avail mem */
 	apc_sma_get_avail_size_f get_avail_size;     /* get avail size */
 	apc_sma_check_integrity_f check_integrity;   /* check integrity */
+	apc_sma_slab_malloc_f slab_malloc;           /* slab malloc */
+	apc_sma_free_f slab_free;                    /* slab free */
 
 	/* callback */
 	apc_sma_expunge_f expunge;                   /* expunge */
@@ -152,7 +155,8 @@ PHP_APCU_API void* apc_sma_api_protect(apc_sma_t* sma, void* p);
 PHP_APCU_API void* apc_sma_api_unprotect(apc_sma_t* sma, void *p);
 
 /*
-* apc_sma_api_info returns information about the allocator
+* apc_sma_api_info returns information about the allocator, the free blocks of
+* every segment followed by the free chunks of every slab, one link per slab
 */
 PHP_APCU_API apc_sma_info_t* apc_sma_api_info(apc_sma_t* sma, zend_bool limited);
 
@@ -162,7 +166,8 @@ PHP_APCU_API apc_sma_info_t* apc_sma_api_info(apc_sma_t* sma, zend_bool limited)
 PHP_APCU_API void apc_sma_api_free_info(apc_sma_t* sma, apc_sma_info_t* info);
 
 /*
-* apc_sma_api_get_avail_mem will return the amount of memory available left to sma
+* apc_sma_api_get_avail_mem will return the amount of memory available left to sma,
+* free chunks of slabs included
 */
 PHP_APCU_API zend_ulong apc_sma_api_get_avail_mem(apc_sma_t* sma);
 
@@ -174,7 +179,19 @@ PHP_APCU_API zend_bool apc_sma_api_get_avail_size(apc_sma_t* sma, size_t size);
 /*
 * apc_sma_api_check_integrity will check the integrity of sma
 */
-PHP_APCU_API void apc_sma_api_check_integrity(apc_sma_t* sma); /* }}} */
+PHP_APCU_API void apc_sma_api_check_integrity(apc_sma_t* sma);
+
+/*
+* apc_sma_api_slab_malloc will allocate a small block of at least size bytes from a slab, setting allocated to its usable size
+*
+* returns NULL if size is too large for a slab, or if no segment has room for another slab; callers should fall back to apc_sma_api_malloc
+*/
+PHP_APCU_API void* apc_sma_api_slab_malloc(apc_sma_t* sma, zend_ulong size, zend_ulong* allocated);
+
+/*
+* apc_sma_api_slab_free will free p (which should be a pointer to a block allocated by apc_sma_api_slab_malloc)
+*/
+PHP_APCU_API void apc_sma_api_slab_free(apc_sma_t* sma, void* p); /* }}} */
 
 /* {{{ ALIGNWORD: pad up x, aligned to the system's word boundary */
 typedef union { void* p; int i; long l; double d; void (*f)(void); } apc_word_t;
@@ -211,7 +228,9 @@ typedef union { void* p; int i; long l; double d; void (*f)(void); } apc_word_t;
 	PHP_APCU_API void apc_sma_api_func(name, free_info)(apc_sma_info_t* info); \
 	PHP_APCU_API zend_ulong apc_sma_api_func(name, get_avail_mem)(void); \
 	PHP_APCU_API zend_bool apc_sma_api_func(name, get_avail_size)(zend_ulong size); \
-	PHP_APCU_API void apc_sma_api_func(name, check_integrity)(void); /* }}} */
+	PHP_APCU_API void apc_sma_api_func(name, check_integrity)(void); \
+	PHP_APCU_API void* apc_sma_api_func(name, slab_malloc)(zend_ulong size, zend_ulong* allocated); \
+	PHP_APCU_API void apc_sma_api_func(name, slab_free)(void* p); /* }}} */
 
 /* {{{ Call in a compilation unit */
 #define apc_sma_api_impl(name, data, expunge) \
@@ -229,6 +248,8 @@ typedef union { void* p; int i; long l; double d; void (*f)(void); } apc_word_t;
 		&apc_sma_api_func(name, get_avail_mem), \
 		&apc_sma_api_func(name, get_avail_size), \
 		&apc_sma_api_func(name, check_integrity), \
+		&apc_sma_api_func(name, slab_malloc), \
+		&apc_sma_api_func(name, slab_free), \
 	}; \
 	PHP_APCU_API void apc_sma_api_func(name, init)(int32_t num, zend_ulong size, char* mask) \
 		{ apc_sma_api_init(apc_sma_api_ptr(name), (void**) data, (apc_sma_expunge_f) expunge, num, size, mask); } \
@@ -255,7 +276,11 @@ typedef union { void* p; int i; long l; double d; void (*f)(void); } apc_word_t;
 	PHP_APCU_API zend_bool apc_sma_api_func(name, get_avail_size)(zend_ulong size) \
 		{ return apc_sma_api_get_avail_size(apc_sma_api_ptr(name), size); } \
 	PHP_APCU_API void apc_sma_api_func(name, check_integrity)() \
-		{ apc_sma_api_check_integrity(apc_sma_api_ptr(name)); }  /* }}} */
+		{ apc_sma_api_check_integrity(apc_sma_api_ptr(name)); } \
+	PHP_APCU_API void* apc_sma_api_func(name, slab_malloc)(zend_ulong size, zend_ulong* allocated) \
+		{ return apc_sma_api_slab_malloc(apc_sma_api_ptr(name), size, allocated); } \
+	PHP_APCU_API void apc_sma_api_func(name, slab_free)(void* p) \
+		{ apc_sma_api_slab_free(apc_sma_api_ptr(name), p); }  /* }}} */
 
 /* {{{ Call wherever access to the SMA object is required */
 #define apc_sma_api_extern(name)     extern apc_sma_t apc_sma_api_name(name) /* }}} */
@@ -0,0 +1,60 @@
+<?php
+/*
+ * Lookup heavy benchmark for the user cache
+ *
+ * Compare slot modes by running it once per configuration, e.g.:
+ *   php -d apc.enable_cli=1 -d apc.pow2_slots=0 bench/lookup.php
+ *   php -d apc.enable_cli=1 -d apc.pow2_slots=1 bench/lookup.php
+ *
+ * Usage: lookup.php [entries [lookups]]
+ *
+ * See bench/README for the settings to compare with.
+ */
+
+if (!extension_loaded('apcu') || !apcu_enabled()) {
+	fwrite(STDERR, "APCu must be loaded and enabled (apc.enable_cli=1)\n");
+	exit(1);
+}
+
+$entries = isset($argv[1]) ? (int) $argv[1] : 100000;
+$lookups = isset($argv[2]) ? (int) $argv[2] : 2000000;
+
+$keys = array();
+for ($i = 0; $i < $entries; $i++) {
+	$keys[] = "bench:key:$i";
+}
+
+$start = microtime(true);
+foreach ($keys as $i => $key) {
+	apcu_store($key, $i);
+}
+$store = microtime(true) - $start;
+
+/* hits only, spread over every key */
+$start = microtime(true);
+for ($i = 0; $i < $lookups; $i++) {
+	apcu_fetch($keys[($i * 7919) % $entries]);
+}
+$hit = microtime(true) - $start;
+
+/* misses only, each walks a whole chain */
+$start = microtime(true);
+for ($i = 0; $i < $lookups; $i++) {
+	apcu_exists("bench:missing:$i");
+}
+$miss = microtime(true) - $start;
+
+$info = apcu_cache_info(true);
+
+printf("pow2_slots: %s, lock_shards: %d, slots: %d, entries: %d\n",
+	ini_get('apc.pow2_slots') ? 'on' : 'off', ini_get('apc.lock_shards'),
+	$info['num_slots'], $info['num_entries']);
+printf("store: %8.0f ops/s\n", $entries / $store);
+printf("hit:   %8.0f ops/s\n", $lookups / $hit);
+printf("miss:  %8.0f ops/s\n", $lookups / $miss);
+
+/* an expunge during the run empties the cache, the numbers are meaningless then */
+if ($info['expunges'] > 0) {
+	fwrite(STDERR, "cache was expunged during the run, raise apc.shm_size\n");
+	exit(1);
+}
@@ -67,6 +67,8 @@ PHP_FUNCTION(apcu_inc);
 PHP_FUNCTION(apcu_dec);
 PHP_FUNCTION(apcu_cas);
 PHP_FUNCTION(apcu_exists);
+PHP_FUNCTION(apcu_store_missing);
+PHP_FUNCTION(apcu_touch);
 /* }}} */
 
 /* {{{ ZEND_DECLARE_MODULE_GLOBALS(apcu) */
@@ -82,13 +84,13 @@ apc_sma_api_extern(apc_sma);
 static void php_apc_init_globals(zend_apcu_globals* apcu_globals)
 {
 	apcu_globals->initialized = 0;
-	apcu_globals->slam_defense = 1;
+	apcu_globals->slam_defense = 0;
 	apcu_globals->smart = 0;
 	apcu_globals->preload_path = NULL;
 	apcu_globals->coredump_unmap = 0;
 	apcu_globals->use_request_time = 1;
 	apcu_globals->serializer_name = NULL;
-	apcu_globals->recursion = 0;
+	apcu_globals->nholds = 0;
 }
 /* }}} */
 
@@ -137,11 +139,25 @@ STD_PHP_INI_ENTRY("apc.entries_hint",   "4096", PHP_INI_SYSTEM, OnUpdateLong,
 STD_PHP_INI_ENTRY("apc.gc_ttl",         "3600", PHP_INI_SYSTEM, OnUpdateLong,              gc_ttl,           zend_apcu_globals, apcu_globals)
 STD_PHP_INI_ENTRY("apc.ttl",            "0",    PHP_INI_SYSTEM, OnUpdateLong,              ttl,              zend_apcu_globals, apcu_globals)
 STD_PHP_INI_ENTRY("apc.smart",          "0",    PHP_INI_SYSTEM, OnUpdateLong,              smart,            zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.eviction",       "expunge", PHP_INI_SYSTEM, OnUpdateStringUnempty,  eviction,         zend_apcu_globals, apcu_globals)
+STD_PHP_INI_BOOLEAN("apc.admission",    "0",    PHP_INI_SYSTEM, OnUpdateBool,              admission,        zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.sweep_slots",    "0",    PHP_INI_SYSTEM, OnUpdateLong,              sweep_slots,      zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.sweep_interval", "0",    PHP_INI_SYSTEM, OnUpdateLong,              sweep_interval,   zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.ttl_jitter",     "0",    PHP_INI_SYSTEM, OnUpdateLong,              ttl_jitter,       zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.entry_wait",     "1000", PHP_INI_SYSTEM, OnUpdateLong,              entry_wait,       zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.lock_shards",    "1",    PHP_INI_SYSTEM, OnUpdateLong,              lock_shards,      zend_apcu_globals, apcu_globals)
+STD_PHP_INI_BOOLEAN("apc.pow2_slots",   "0",    PHP_INI_SYSTEM, OnUpdateBool,              pow2_slots,       zend_apcu_globals, apcu_globals)
 #if APC_MMAP
 STD_PHP_INI_ENTRY("apc.mmap_file_mask",  NULL,  PHP_INI_SYSTEM, OnUpdateString,            mmap_file_mask,   zend_apcu_globals, apcu_globals)
 #endif
 STD_PHP_INI_BOOLEAN("apc.enable_cli",   "0",    PHP_INI_SYSTEM, OnUpdateBool,              enable_cli,       zend_apcu_globals, apcu_globals)
-STD_PHP_INI_BOOLEAN("apc.slam_defense", "1",    PHP_INI_SYSTEM, OnUpdateBool,              slam_defense,     zend_apcu_globals, apcu_globals)
+STD_PHP_INI_BOOLEAN("apc.slam_defense", "0",    PHP_INI_SYSTEM, OnUpdateBool,              slam_defense,     zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.slam_keys",      "256",  PHP_INI_SYSTEM, OnUpdateLong,              slam_keys,        zend_apcu_globals, apcu_globals)
+STD_PHP_INI_BOOLEAN("apc.optimistic_reads", "1", PHP_INI_SYSTEM, OnUpdateBool,           optimistic_reads, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.reader_slots",   "1024", PHP_INI_SYSTEM, OnUpdateLong,              reader_slots,     zend_apcu_globals, apcu_globals)
+STD_PHP_INI_BOOLEAN("apc.count_lookups", "1", PHP_INI_SYSTEM, OnUpdateBool,              count_lookups,    zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.atime_granularity", "0", PHP_INI_SYSTEM, OnUpdateLong,              atime_granularity, zend_apcu_globals, apcu_globals)
+STD_PHP_INI_ENTRY("apc.hits_sample",    "1",    PHP_INI_SYSTEM, OnUpdateLong,              hits_sample,      zend_apcu_globals, apcu_globals)
 STD_PHP_INI_ENTRY("apc.preload_path", (char*)NULL,              PHP_INI_SYSTEM, OnUpdateString,       preload_path,  zend_apcu_globals, apcu_globals)
 STD_PHP_INI_BOOLEAN("apc.coredump_unmap", "0", PHP_INI_SYSTEM, OnUpdateBool, coredump_unmap, zend_apcu_globals, apcu_globals)
 STD_PHP_INI_BOOLEAN("apc.use_request_time", "1", PHP_INI_ALL, OnUpdateBool, use_request_time,  zend_apcu_globals, apcu_globals)
@@ -250,7 +266,35 @@ static PHP_MINIT_FUNCTION(apcu)
 			apc_user_cache = apc_cache_create(
 				&apc_sma,
 				apc_find_serializer(APCG(serializer_name)),
-				APCG(entries_hint), APCG(gc_ttl), APCG(ttl), APCG(smart), APCG(slam_defense));
+				APCG(entries_hint), APCG(gc_ttl), APCG(ttl), APCG(smart), APCG(slam_defense) ? APCG(slam_keys) : 0,
+				APCG(lock_shards), APCG(pow2_slots), APCG(admission), APCG(reader_slots));
+
+			/* lookups without the shard lock */
+			apc_user_cache->optimistic_reads = APCG(optimistic_reads);
+
+			/* hit and miss counters */
+			apc_user_cache->count_lookups = APCG(count_lookups);
+
+			/* writes of access times and hits of entries on lookups */
+			apc_user_cache->atime_granularity = APCG(atime_granularity);
+			apc_user_cache->hits_sample = APCG(hits_sample);
+
+			/* eviction policy when memory runs out */
+			if (strcasecmp(APCG(eviction), "clock") == 0) {
+				apc_user_cache->eviction = APC_CACHE_EVICT_CLOCK;
+			} else if (strcasecmp(APCG(eviction), "expunge") != 0) {
+				apc_warning("Unknown apc.eviction policy '%s', falling back to 'expunge'", APCG(eviction));
+			}
+
+			/* incremental sweeping at the end of requests */
+			apc_user_cache->sweep_slots = APCG(sweep_slots);
+			apc_user_cache->sweep_interval = APCG(sweep_interval);
+
+			/* apcu_entry() callers waiting for a value generated elsewhere */
+			apc_user_cache->entry_wait = APCG(entry_wait);
+
+			/* entries stored together expire spread over a window */
+			apc_user_cache->ttl_jitter = APCG(ttl_jitter);
 
 			/* initialize pooling */
 			apc_pool_init();
@@ -307,6 +351,14 @@ static PHP_RINIT_FUNCTION(apcu)
 #endif
 
 	APCG(request_time) = 0;
+
+	/* workers count hits and misses into different counter shards */
+#ifdef ZTS
+	APCG(counter_slot) = (zend_ulong) (zend_uintptr_t) TSRMLS_CACHE / sizeof(void *);
+#else
+	APCG(counter_slot) = (zend_ulong) getpid();
+#endif
+
 	if (APCG(enabled)) {
 		if (APCG(serializer_name)) {
 			/* Avoid race conditions between MINIT of apc and serializer exts like igbinary */
@@ -321,6 +373,22 @@ static PHP_RINIT_FUNCTION(apcu)
 }
 /* }}} */
 
+/* {{{ PHP_RSHUTDOWN_FUNCTION(apcu) */
+static PHP_RSHUTDOWN_FUNCTION(apcu)
+{
+	/* leave the read sections of entries found but never released */
+	while (APCG(nholds)) {
+		apc_cache_entry_release(APCG(holds)[0].cache, APCG(holds)[0].entry);
+	}
+
+	/* the response was sent already, sweep a few slots for expired entries and cleared generations */
+	if (APCG(enabled)) {
+		apc_cache_sweep(apc_user_cache);
+	}
+	return SUCCESS;
+}
+/* }}} */
+
 /* {{{ proto void apcu_clear_cache() */
 PHP_FUNCTION(apcu_clear_cache)
 {
@@ -435,6 +503,42 @@ int php_apc_update(
 }
 /* }}} */
 
+/* {{{ php_apc_option_long
+ Returns the option name of options as a long, or def when it is not set */
+static zend_long php_apc_option_long(HashTable *options, const char *name, size_t len, zend_long def) {
+	zval *option;
+
+	if (!options || !(option = zend_hash_str_find(options, name, len))) {
+		return def;
+	}
+
+	return zval_get_long(option);
+} /* }}} */
+
+/* {{{ php_apc_option_bool
+ Returns the option name of options as a bool, or def when it is not set */
+static zend_bool php_apc_option_bool(HashTable *options, const char *name, size_t len, zend_bool def) {
+	zval *option;
+
+	if (!options || !(option = zend_hash_str_find(options, name, len))) {
+		return def;
+	}
+
+	return zend_is_true(option);
+} /* }}} */
+
+/* {{{ php_apc_option_double
+ Returns the option name of options as a double, or def when it is not set */
+static double php_apc_option_double(HashTable *options, const char *name, size_t len, double def) {
+	zval *option;
+
+	if (!options || !(option = zend_hash_str_find(options, name, len))) {
+		return def;
+	}
+
+	return zval_get_double(option);
+} /* }}} */
+
 /* {{{ apc_store_helper(INTERNAL_FUNCTION_PARAMETERS, const zend_bool exclusive)
  */
 static void apc_store_helper(INTERNAL_FUNCTION_PARAMETERS, const zend_bool exclusive)
@@ -442,11 +546,28 @@ static void apc_store_helper(INTERNAL_FUNCTION_PARAMETERS, const zend_bool exclu
 	zval *key;
 	zval *val = NULL;
 	zend_long ttl = 0L;
+	HashTable *options = NULL;
+	uint32_t flags = 0;
+	zend_long jitter;
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z|zl", &key, &val, &ttl) == FAILURE) {
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "z|zlh", &key, &val, &ttl, &options) == FAILURE) {
 		return;
 	}
 
+	if (php_apc_option_bool(options, "pin", sizeof("pin")-1, 0)) {
+		flags |= APC_CACHE_ENTRY_PINNED;
+	}
+
+	if (php_apc_option_bool(options, "sliding", sizeof("sliding")-1, 0)) {
+		flags |= APC_CACHE_ENTRY_SLIDING;
+	}
+
+	jitter = php_apc_option_long(options, "jitter", sizeof("jitter")-1, APCG(ttl_jitter));
+	if (jitter < 0 || jitter > 100) {
+		apc_warning("%s() expects the jitter option to be between 0 and 100", exclusive ? "apcu_add" : "apcu_store");
+		RETURN_FALSE;
+	}
+
 	if (!APCG(enabled)) {
 		RETURN_FALSE;
 	}
@@ -466,7 +587,7 @@ static void apc_store_helper(INTERNAL_FUNCTION_PARAMETERS, const zend_bool exclu
 		array_init(return_value);
 		ZEND_HASH_FOREACH_KEY_VAL(hash, hkey_idx, hkey, hentry) {
 			if (hkey) {
-				if (!apc_cache_store(apc_user_cache, hkey, hentry, (uint32_t) ttl, exclusive)) {
+				if (!apc_cache_store_ex(apc_user_cache, hkey, hentry, (uint32_t) ttl, exclusive, flags, jitter)) {
 					add_assoc_long_ex(return_value, hkey->val, hkey->len, -1);  /* -1: insertion error */
 				}
 			} else {
@@ -480,7 +601,7 @@ static void apc_store_helper(INTERNAL_FUNCTION_PARAMETERS, const zend_bool exclu
 			RETURN_FALSE;
 		}
 		/* return true on success */
-		if (apc_cache_store(apc_user_cache, Z_STR_P(key), val, (uint32_t) ttl, exclusive)) {
+		if (apc_cache_store_ex(apc_user_cache, Z_STR_P(key), val, (uint32_t) ttl, exclusive, flags, jitter)) {
 			RETURN_TRUE;
 		}
 	} else {
@@ -498,20 +619,59 @@ PHP_FUNCTION(apcu_enabled) {
 	RETURN_BOOL(APCG(enabled));
 }  /* }}} */
 
-/* {{{ proto int apcu_store(mixed key, mixed var [, long ttl ])
- */
+/* {{{ proto int apcu_store(mixed key, mixed var [, long ttl [, array options ]])
+	options:
+		pin:     the entry is never evicted to make room, only its ttl, deletes and clears remove it
+		jitter:  percent of the ttl the entry may expire early by, at random (default: apc.ttl_jitter)
+		sliding: the ttl starts over whenever the entry is fetched */
 PHP_FUNCTION(apcu_store) {
 	apc_store_helper(INTERNAL_FUNCTION_PARAM_PASSTHRU, 0);
 }
 /* }}} */
 
-/* {{{ proto int apcu_add(mixed key, mixed var [, long ttl ])
- */
+/* {{{ proto int apcu_add(mixed key, mixed var [, long ttl [, array options ]])
+	options: see apcu_store() */
 PHP_FUNCTION(apcu_add) {
 	apc_store_helper(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
 }
 /* }}} */
 
+/* {{{ proto bool apcu_touch(string key, long ttl)
+	starts the ttl of key over from now, without storing its value again, keys stored as missing are not touched */
+PHP_FUNCTION(apcu_touch) {
+	zend_string *key;
+	zend_long ttl;
+
+	if (!APCG(enabled)) {
+		RETURN_FALSE;
+	}
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "Sl", &key, &ttl) == FAILURE) {
+		return;
+	}
+
+	RETURN_BOOL(apc_cache_touch(apc_user_cache, key, (int32_t) ttl));
+}
+/* }}} */
+
+/* {{{ proto bool apcu_store_missing(string key [, long ttl ])
+	records key as known to be missing, apcu_fetch() then sets success to null */
+PHP_FUNCTION(apcu_store_missing) {
+	zend_string *key;
+	zend_long ttl = 0;
+
+	if (!APCG(enabled)) {
+		RETURN_FALSE;
+	}
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "S|l", &key, &ttl) == FAILURE) {
+		return;
+	}
+
+	RETURN_BOOL(apc_cache_store_missing(apc_user_cache, key, (int32_t) ttl));
+}
+/* }}} */
+
 /* {{{ php_inc_updater */
 
 struct php_inc_updater_args {
@@ -664,11 +824,19 @@ PHP_FUNCTION(apcu_fetch) {
 
 	if (Z_TYPE_P(key) == IS_ARRAY || (Z_TYPE_P(key) == IS_STRING && Z_STRLEN_P(key) > 0)) {
 		if (Z_TYPE_P(key) == IS_STRING) {
-			if (apc_cache_fetch(apc_user_cache, Z_STR_P(key), t, &return_value)) {
+			zend_bool missing;
+
+			if (apc_cache_fetch_ex(apc_user_cache, Z_STR_P(key), t, &return_value, &missing)) {
 				if (success) {
 					ZVAL_TRUE(success);
 				}
-			} else { RETVAL_FALSE; }
+			} else {
+				/* keys known to be missing are told apart from plain misses */
+				if (success && missing) {
+					ZVAL_NULL(success);
+				}
+				RETVAL_FALSE;
+			}
 		} else if (Z_TYPE_P(key) == IS_ARRAY) {
 			zval *hentry;
 			zval result;
@@ -807,18 +975,39 @@ PHP_FUNCTION(apcu_delete) {
 	}
 }
 
+/* {{{ proto mixed apcu_entry(string key, callable generator [, long ttl [, array options ]])
+	options:
+		grace: seconds the value may still be returned once the ttl passed, while the
+		       first caller after the ttl passed runs the generator
+		beta:  refresh the value early, with a probability growing as the ttl nears, and
+		       with the time the generator took, larger values refresh earlier (XFetch) */
 PHP_FUNCTION(apcu_entry) {
 	zval *key = NULL;
 	zend_fcall_info fci = empty_fcall_info;
 	zend_fcall_info_cache fcc = empty_fcall_info_cache;
 	zend_long ttl = 0L;
+	zend_long grace;
+	double beta;
+	HashTable *options = NULL;
 	zend_long now = apc_time();
 
-	if (zend_parse_parameters(ZEND_NUM_ARGS(), "zf|l", &key, &fci, &fcc, &ttl) != SUCCESS) {
+	if (zend_parse_parameters(ZEND_NUM_ARGS(), "zf|lh", &key, &fci, &fcc, &ttl, &options) != SUCCESS) {
 		return;
 	}
 
-	apc_cache_entry(apc_user_cache, key, &fci, &fcc, ttl, now, return_value);
+	grace = php_apc_option_long(options, "grace", sizeof("grace")-1, 0);
+	if (grace < 0) {
+		apc_warning("apcu_entry() expects the grace option to be greater than or equal to 0");
+		RETURN_FALSE;
+	}
+
+	beta = php_apc_option_double(options, "beta", sizeof("beta")-1, 0);
+	if (beta < 0) {
+		apc_warning("apcu_entry() expects the beta option to be greater than or equal to 0");
+		RETURN_FALSE;
+	}
+
+	apc_cache_entry(apc_user_cache, key, &fci, &fcc, ttl, grace, beta, now, return_value);
 }
 /* }}} */
 
@@ -855,6 +1044,8 @@ zend_function_entry apcu_functions[] = {
 	PHP_FE(apcu_fetch,              arginfo_apcu_fetch)
 	PHP_FE(apcu_delete,             arginfo_apcu_delete)
 	PHP_FE(apcu_add,                arginfo_apcu_store)
+	PHP_FE(apcu_store_missing,      arginfo_apcu_store_missing)
+	PHP_FE(apcu_touch,              arginfo_apcu_touch)
 	PHP_FE(apcu_inc,                arginfo_apcu_inc)
 	PHP_FE(apcu_dec,                arginfo_apcu_inc)
 	PHP_FE(apcu_cas,                arginfo_apcu_cas)
@@ -876,7 +1067,7 @@ zend_module_entry apcu_module_entry = {
 	PHP_MINIT(apcu),
 	PHP_MSHUTDOWN(apcu),
 	PHP_RINIT(apcu),
-	NULL,
+	PHP_RSHUTDOWN(apcu),
 	PHP_MINFO(apcu),
 	PHP_APCU_VERSION,
 	STANDARD_MODULE_PROPERTIES
@@ -41,6 +41,8 @@ PHP_APCU_API PHP_FUNCTION(apcu_delete);
 PHP_APCU_API PHP_FUNCTION(apcu_exists);
 PHP_APCU_API PHP_FUNCTION(apcu_fetch);
 PHP_APCU_API PHP_FUNCTION(apcu_store);
+PHP_APCU_API PHP_FUNCTION(apcu_store_missing);
+PHP_APCU_API PHP_FUNCTION(apcu_touch);
 PHP_APCU_API PHP_FUNCTION(apcu_inc);
 PHP_APCU_API PHP_FUNCTION(apcu_dec);
 PHP_APCU_API PHP_FUNCTION(apcu_cas);
@@ -0,0 +1,60 @@
+--TEST--
+APC: user cache striped over several lock shards
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.lock_shards=8
+apc.entries_hint=1024
+--FILE--
+<?php
+for ($i = 0; $i < 100; $i++) {
+	apcu_store("key$i", $i);
+}
+
+$ok = true;
+for ($i = 0; $i < 100; $i++) {
+	$ok = $ok && apcu_fetch("key$i") === $i && apcu_exists("key$i");
+}
+var_dump($ok);
+
+var_dump(apcu_delete("key0"));
+var_dump(apcu_exists("key0"));
+var_dump(apcu_inc("key1", 10));
+
+$info = apcu_cache_info();
+var_dump($info['num_entries']);
+var_dump(count($info['cache_list']));
+var_dump(array_sum($info['slot_distribution']));
+
+$it = new APCuIterator('/^key/');
+var_dump(iterator_count($it));
+var_dump($it->getTotalCount());
+
+var_dump(apcu_entry("gen", function($key) {
+	return "generated";
+}));
+var_dump(apcu_fetch("gen"));
+
+var_dump(apcu_clear_cache());
+var_dump(apcu_cache_info()['num_entries']);
+var_dump(apcu_fetch("key1"));
+?>
+===DONE===
+--EXPECT--
+bool(true)
+bool(true)
+bool(false)
+int(11)
+int(99)
+int(99)
+int(99)
+int(99)
+int(99)
+string(9) "generated"
+string(9) "generated"
+bool(true)
+int(0)
+bool(false)
+===DONE===
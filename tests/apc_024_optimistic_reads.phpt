@@ -0,0 +1,38 @@
+--TEST--
+APC: lookups without the shard lock
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.optimistic_reads=1
+--FILE--
+<?php
+apcu_store("foo", "bar");
+var_dump(apcu_fetch("foo"));
+var_dump(apcu_exists("foo"));
+
+apcu_store("foo", "baz");
+var_dump(apcu_fetch("foo"));
+
+var_dump(apcu_delete("foo"));
+var_dump(apcu_fetch("foo"));
+var_dump(apcu_exists("foo"));
+
+$info = apcu_cache_info();
+var_dump($info['num_hits']);
+var_dump($info['num_misses']);
+var_dump($info['num_entries']);
+?>
+===DONE===
+--EXPECT--
+string(3) "bar"
+bool(true)
+string(3) "baz"
+bool(true)
+bool(false)
+bool(false)
+float(2)
+float(1)
+int(0)
+===DONE===
@@ -0,0 +1,44 @@
+--TEST--
+APC: slot table grows when more entries are stored than hinted
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.entries_hint=16
+apc.shm_size=32M
+--FILE--
+<?php
+$initial = apcu_cache_info(true)['num_slots'];
+
+for ($i = 0; $i < 3000; $i++) {
+	apcu_store("key$i", $i);
+}
+
+$info = apcu_cache_info();
+var_dump($info['num_slots'] > $initial);
+var_dump($info['num_entries']);
+var_dump(array_sum($info['slot_distribution']));
+
+$ok = true;
+for ($i = 0; $i < 3000; $i++) {
+	$ok = $ok && apcu_fetch("key$i") === $i;
+}
+var_dump($ok);
+
+for ($i = 0; $i < 3000; $i += 2) {
+	apcu_delete("key$i");
+}
+var_dump(apcu_exists("key0"), apcu_exists("key1"));
+var_dump(iterator_count(new APCuIterator('/^key/')));
+?>
+===DONE===
+--EXPECT--
+bool(true)
+int(3000)
+int(3000)
+bool(true)
+bool(false)
+bool(true)
+int(1500)
+===DONE===
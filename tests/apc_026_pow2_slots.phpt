@@ -0,0 +1,36 @@
+--TEST--
+APC: power of two slot tables
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.pow2_slots=1
+apc.entries_hint=4096
+--FILE--
+<?php
+var_dump(apcu_cache_info(true)['num_slots']);
+
+for ($i = 0; $i < 5000; $i++) {
+	apcu_store("key$i", $i);
+}
+
+$slots = apcu_cache_info(true)['num_slots'];
+var_dump($slots > 1024, ($slots & ($slots - 1)) === 0);
+
+$ok = true;
+for ($i = 0; $i < 5000; $i++) {
+	$ok = $ok && apcu_fetch("key$i") === $i;
+}
+var_dump($ok);
+var_dump(apcu_delete("key42"), apcu_exists("key42"));
+?>
+===DONE===
+--EXPECT--
+int(1024)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(false)
+===DONE===
@@ -0,0 +1,60 @@
+--TEST--
+APC: entries keep their key inline and their times relative to the cache
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+$long = str_repeat("k", 1000);
+$now = time();
+
+var_dump(apcu_store("a", "one"));
+var_dump(apcu_store($long, "long"));
+var_dump(apcu_store("short", "short", 100));
+
+var_dump(apcu_fetch("a"));
+var_dump(apcu_fetch($long));
+var_dump(apcu_fetch("short"));
+
+$info = apcu_key_info("short");
+var_dump($info['ttl']);
+var_dump($info['creation_time'] >= $now && $info['creation_time'] <= time());
+var_dump($info['mtime'] == $info['creation_time']);
+var_dump($info['access_time'] >= $info['creation_time']);
+var_dump($info['deletion_time']);
+
+$keys = array();
+foreach (new APCuIterator(null, APC_ITER_KEY | APC_ITER_CTIME) as $item) {
+	$keys[] = strlen($item['key']);
+	var_dump($item['creation_time'] >= $now);
+}
+sort($keys);
+var_dump($keys);
+?>
+===DONE===
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+string(3) "one"
+string(4) "long"
+string(5) "short"
+int(100)
+bool(true)
+bool(true)
+bool(true)
+int(0)
+bool(true)
+bool(true)
+bool(true)
+array(3) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(5)
+  [2]=>
+  int(1000)
+}
+===DONE===
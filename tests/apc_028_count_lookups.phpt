@@ -0,0 +1,25 @@
+--TEST--
+APC: hits and misses are not counted with apc.count_lookups=0
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.count_lookups=0
+--FILE--
+<?php
+apcu_store("foo", "bar");
+var_dump(apcu_fetch("foo"));
+var_dump(apcu_fetch("missing"));
+
+$info = apcu_cache_info(true);
+var_dump($info['num_hits']);
+var_dump($info['num_misses']);
+?>
+===DONE===
+--EXPECT--
+string(3) "bar"
+bool(false)
+float(0)
+float(0)
+===DONE===
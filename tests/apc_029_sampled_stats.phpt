@@ -0,0 +1,32 @@
+--TEST--
+APC: sampled hits and coarse access times of entries
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=0
+apc.hits_sample=4
+apc.atime_granularity=100
+--FILE--
+<?php
+apcu_store("foo", "bar");
+$ctime = apcu_key_info("foo")['creation_time'];
+
+for ($i = 0; $i < 400; $i++) {
+	apcu_fetch("foo");
+}
+
+$info = apcu_key_info("foo");
+var_dump($info['hits'] > 0 && $info['hits'] % 4 == 0);
+var_dump($info['access_time'] == $ctime);
+
+$info = apcu_cache_info();
+var_dump($info['num_hits']);
+?>
+===DONE===
+--EXPECT--
+bool(true)
+bool(true)
+float(400)
+===DONE===
@@ -0,0 +1,35 @@
+--TEST--
+APC: clock eviction keeps hit entries instead of wiping the cache
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.shm_size=1M
+apc.optimistic_reads=0
+apc.eviction=clock
+--FILE--
+<?php
+apcu_store("hot", "value");
+$value = str_repeat("x", 4000);
+
+$stored = 0;
+for ($i = 0; $i < 2000; $i++) {
+	$stored += apcu_store("key$i", $value);
+	apcu_fetch("hot");
+}
+
+var_dump($stored);
+var_dump(apcu_fetch("hot"));
+var_dump(apcu_fetch("key1999") === $value);
+var_dump(apcu_exists("key0"));
+var_dump(apcu_cache_info(true)['num_entries'] > 1);
+?>
+===DONE===
+--EXPECT--
+int(2000)
+string(5) "value"
+bool(true)
+bool(false)
+bool(true)
+===DONE===
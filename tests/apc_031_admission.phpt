@@ -0,0 +1,49 @@
+--TEST--
+APC: admission filter keeps one-shot keys from pushing out hot entries
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.shm_size=1M
+apc.optimistic_reads=0
+apc.eviction=clock
+apc.admission=1
+--FILE--
+<?php
+$value = str_repeat("x", 4000);
+
+for ($i = 0; $i < 100; $i++) {
+	apcu_store("hot$i", $value);
+}
+for ($j = 0; $j < 5; $j++) {
+	for ($i = 0; $i < 100; $i++) {
+		apcu_fetch("hot$i");
+	}
+}
+
+$rejected = 0;
+for ($i = 0; $i < 500; $i++) {
+	if (!apcu_store("once$i", $value)) {
+		$rejected++;
+	}
+}
+var_dump($rejected > 0);
+
+$hot = 0;
+for ($i = 0; $i < 100; $i++) {
+	$hot += apcu_exists("hot$i");
+}
+var_dump($hot);
+
+/* replacing a cached key is always admitted */
+var_dump(apcu_store("hot0", "replaced"));
+var_dump(apcu_fetch("hot0"));
+?>
+===DONE===
+--EXPECT--
+bool(true)
+int(100)
+bool(true)
+string(8) "replaced"
+===DONE===
@@ -0,0 +1,47 @@
+--TEST--
+APC: expired entries are removed through the timing wheel
+--SKIPIF--
+<?php
+require_once(__DIR__ . '/skipif.inc');
+if (!function_exists('apcu_inc_request_time')) die('skip APC debug build required');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=1
+--FILE--
+<?php
+for ($i = 0; $i < 100; $i++) {
+	apcu_store("short$i", $i, 1);
+	apcu_store("long$i", $i, 100);
+	apcu_store("far$i", $i, 10000);
+}
+apcu_store("forever", 1);
+var_dump(apcu_cache_info(true)['num_entries']);
+
+/* inserting advances the wheel of one shard, every shard is advanced on expunge */
+apcu_inc_request_time(3);
+apcu_store("trigger", 1);
+var_dump(apcu_cache_info(true)['num_entries']);
+var_dump(apcu_fetch("long0"));
+
+apcu_inc_request_time(200);
+apcu_store("trigger", 2);
+var_dump(apcu_cache_info(true)['num_entries']);
+var_dump(apcu_fetch("far99"));
+
+apcu_inc_request_time(10000);
+apcu_store("trigger", 3);
+var_dump(apcu_cache_info(true)['num_entries']);
+var_dump(apcu_fetch("forever"));
+?>
+===DONE===
+--EXPECT--
+int(301)
+int(202)
+int(0)
+int(102)
+int(99)
+int(2)
+int(1)
+===DONE===
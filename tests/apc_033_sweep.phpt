@@ -0,0 +1,51 @@
+--TEST--
+APC: expired entries are swept at the end of requests
+--SKIPIF--
+<?php
+    require_once(dirname(__FILE__) . '/skipif.inc');
+	if (PHP_OS == "WINNT") die("skip: not on windows");
+	if (!function_exists('apcu_inc_request_time')) die('skip APC debug build required');
+?>
+--FILE--
+<?php
+include "server_test.inc";
+
+$file = <<<FL
+if (!apcu_exists("init")) {
+	apcu_store("init", 1);
+	for (\$i = 0; \$i < 100; \$i++) {
+		apcu_store("key\$i", \$i, 1);
+	}
+}
+/* the sweep at the end of this request runs past the ttl */
+if (isset(\$_GET['later'])) {
+	apcu_inc_request_time(3);
+}
+echo apcu_cache_info(true)['num_entries'], "\n";
+FL;
+
+$args = array(
+	'apc.enabled=1',
+	'apc.enable_cli=1',
+	'apc.sweep_slots=16',
+	'apc.use_request_time=1',
+);
+
+server_start($file, $args);
+
+run_test_simple();
+run_test_simple('?later=1');
+run_test_simple();
+echo 'done';
+?>
+--EXPECT--
+101
+101
+101
+101
+101
+101
+1
+1
+1
+done
@@ -0,0 +1,40 @@
+--TEST--
+APC: removed entries are freed once no reader can hold them
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.optimistic_reads=1
+--FILE--
+<?php
+apcu_store("foo", [1, 2, 3]);
+var_dump(apcu_fetch("foo"));
+
+apcu_delete("foo");
+$info = apcu_cache_info();
+var_dump(count($info["deleted_list"]));
+var_dump($info["deleted_list"][0]["info"]);
+
+/* nobody reads anymore, the next insert frees the entry */
+apcu_store("bar", 1);
+$info = apcu_cache_info();
+var_dump(count($info["deleted_list"]));
+var_dump(apcu_fetch("bar"));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+array(3) {
+  [0]=>
+  int(1)
+  [1]=>
+  int(2)
+  [2]=>
+  int(3)
+}
+int(1)
+string(3) "foo"
+int(0)
+int(1)
+===DONE===
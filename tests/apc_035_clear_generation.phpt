@@ -0,0 +1,48 @@
+--TEST--
+APC: clearing the cache swaps in a new generation which is usable right away
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+for ($i = 0; $i < 100; $i++) {
+	apcu_store("key$i", str_repeat("x", 100));
+}
+
+$info = apcu_cache_info(true);
+var_dump($info["num_entries"], $info["generation"]);
+
+apcu_clear_cache();
+
+$info = apcu_cache_info(true);
+var_dump($info["num_entries"], $info["mem_size"], $info["generation"]);
+var_dump(apcu_fetch("key1"));
+
+/* reads and writes work in the new generation */
+var_dump(apcu_store("key1", "new"));
+var_dump(apcu_fetch("key1"));
+var_dump(apcu_exists("key2"));
+
+apcu_clear_cache();
+$info = apcu_cache_info(true);
+var_dump($info["num_entries"], $info["generation"]);
+var_dump(apcu_fetch("key1"));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+int(100)
+int(0)
+int(0)
+float(0)
+int(1)
+bool(false)
+bool(true)
+string(3) "new"
+bool(false)
+int(0)
+int(2)
+bool(false)
+===DONE===
@@ -0,0 +1,67 @@
+--TEST--
+APC: apcu_entry returns stale values within the grace period while one caller refreshes
+--SKIPIF--
+<?php
+require_once(__DIR__ . '/skipif.inc');
+if (!function_exists('apcu_inc_request_time')) die('skip APC debug build required');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=1
+--FILE--
+<?php
+function generate($value) {
+	return function ($key) use ($value) {
+		echo "generate $key\n";
+		return $value;
+	};
+}
+
+var_dump(apcu_entry("key", generate("v1"), 1, ["grace" => 100]));
+
+apcu_inc_request_time(2);
+
+/* the ttl passed, plain fetches miss */
+var_dump(apcu_fetch("key"));
+
+/* the first caller refreshes, but fails */
+try {
+	apcu_entry("key", function ($key) {
+		throw new Exception("refresh of $key failed");
+	}, 1, ["grace" => 100]);
+} catch (Exception $e) {
+	echo $e->getMessage(), "\n";
+}
+
+/* the refresh was handed out already, the stale value is returned */
+var_dump(apcu_entry("key", generate("v2"), 1, ["grace" => 100]));
+
+/* the refresh is handed out again after a while */
+apcu_inc_request_time(11);
+var_dump(apcu_entry("key", generate("v3"), 1, ["grace" => 100]));
+var_dump(apcu_fetch("key"));
+
+/* once the grace period passed, the entry is gone */
+apcu_inc_request_time(200);
+var_dump(apcu_entry("key", generate("v4"), 1));
+
+var_dump(apcu_entry("key", generate("v5"), 1, ["grace" => -1]));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECTF--
+generate key
+string(2) "v1"
+bool(false)
+refresh of key failed
+string(2) "v1"
+generate key
+string(2) "v3"
+string(2) "v3"
+generate key
+string(2) "v4"
+
+Warning: apcu_entry(): apcu_entry() expects the grace option to be greater than or equal to 0 in %s on line %d
+bool(false)
+===DONE===
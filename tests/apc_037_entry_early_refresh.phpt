@@ -0,0 +1,42 @@
+--TEST--
+APC: apcu_entry refreshes values early with the beta option
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+function generate($value, $usleep = 0) {
+	return function ($key) use ($value, $usleep) {
+		echo "generate $key\n";
+		usleep($usleep);
+		return $value;
+	};
+}
+
+/* the generator takes a while, which is remembered with the entry */
+var_dump(apcu_entry("key", generate("v1", 100000), 100, ["beta" => 1e9]));
+
+/* without beta, values are only generated on misses */
+var_dump(apcu_entry("key", generate("v2"), 100));
+
+/* a huge beta makes the refresh all but certain, long before the ttl passes */
+var_dump(apcu_entry("key", generate("v3"), 100, ["beta" => 1e9]));
+var_dump(apcu_fetch("key"));
+
+var_dump(apcu_entry("key", generate("v4"), 100, ["beta" => -1]));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECTF--
+generate key
+string(2) "v1"
+string(2) "v1"
+generate key
+string(2) "v3"
+string(2) "v3"
+
+Warning: apcu_entry(): apcu_entry() expects the beta option to be greater than or equal to 0 in %s on line %d
+bool(false)
+===DONE===
@@ -0,0 +1,48 @@
+--TEST--
+APC: apcu_entry generators run without locking the cache
+--SKIPIF--
+<?php require_once(__DIR__ . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+var_dump(apcu_entry("outer", function ($key) {
+	/* other keys stay available while the value is generated */
+	apcu_store("other", "stored");
+	var_dump(apcu_fetch("other"));
+	var_dump(apcu_delete("other"));
+
+	/* nested generators for the same key do not wait for themselves */
+	var_dump(apcu_entry($key, function ($key) {
+		return "inner";
+	}));
+
+	return "outer";
+}));
+var_dump(apcu_fetch("outer"));
+
+/* a failed generator leaves nothing behind */
+try {
+	apcu_entry("failed", function ($key) {
+		throw new Exception("$key failed");
+	});
+} catch (Exception $e) {
+	echo $e->getMessage(), "\n";
+}
+
+var_dump(apcu_entry("failed", function ($key) {
+	return "generated";
+}));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+string(6) "stored"
+bool(true)
+string(5) "inner"
+string(5) "outer"
+string(5) "inner"
+failed failed
+string(9) "generated"
+===DONE===
@@ -0,0 +1,57 @@
+--TEST--
+APC: apcu_store_missing records keys known to be missing
+--SKIPIF--
+<?php require_once(__DIR__ . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+--FILE--
+<?php
+var_dump(apcu_store_missing("missing"));
+
+/* a known missing key is told apart from a plain miss by success */
+var_dump(apcu_fetch("missing", $success), $success);
+var_dump(apcu_fetch("unknown", $success), $success);
+var_dump(apcu_fetch(["missing", "unknown"]));
+var_dump(apcu_exists("missing"));
+
+/* updates do not apply to missing keys, adds and stores replace them */
+var_dump(apcu_cas("missing", 0, 1));
+var_dump(apcu_inc("missing"));
+var_dump(apcu_fetch("missing", $success), $success);
+
+apcu_store_missing("missing");
+var_dump(apcu_add("missing", "added"));
+var_dump(apcu_fetch("missing", $success), $success);
+
+/* and a store of a missing key replaces its value */
+var_dump(apcu_store_missing("missing"));
+var_dump(apcu_fetch("missing", $success), $success);
+
+var_dump(apcu_entry("missing", function ($key) {
+	return "generated";
+}));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+bool(true)
+bool(false)
+NULL
+bool(false)
+bool(false)
+array(0) {
+}
+bool(false)
+bool(false)
+int(1)
+int(1)
+bool(true)
+bool(true)
+string(5) "added"
+bool(true)
+bool(true)
+bool(false)
+NULL
+string(9) "generated"
+===DONE===
@@ -0,0 +1,49 @@
+--TEST--
+APC: pinned entries survive expunges, but not clears
+--SKIPIF--
+<?php require_once(__DIR__ . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.shm_size=8M
+--FILE--
+<?php
+var_dump(apcu_store("flags", ["feature" => true], 0, ["pin" => true]));
+var_dump(apcu_add("routes", ["/" => "index"], 0, ["pin" => true]));
+var_dump(apcu_store("plain", 1));
+var_dump(apcu_key_info("flags")["pinned"], apcu_key_info("plain")["pinned"]);
+
+/* fill the cache until it is expunged */
+$value = str_repeat("x", 256 * 1024);
+for ($i = 0; $i < 100; $i++) {
+	apcu_store("filler$i", $value);
+}
+var_dump(apcu_cache_info(true)["expunges"] > 0);
+
+var_dump(apcu_fetch("flags"), apcu_fetch("routes"));
+var_dump(apcu_fetch("plain"));
+
+/* clears remove pinned entries too */
+apcu_clear_cache();
+var_dump(apcu_fetch("flags"));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(false)
+bool(true)
+array(1) {
+  ["feature"]=>
+  bool(true)
+}
+array(1) {
+  ["/"]=>
+  string(5) "index"
+}
+bool(false)
+bool(false)
+===DONE===
@@ -0,0 +1,43 @@
+--TEST--
+APC: ttl jitter spreads the expiry of entries stored together
+--SKIPIF--
+<?php require_once(__DIR__ . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.ttl_jitter=50
+--FILE--
+<?php
+$ttls = [];
+for ($i = 0; $i < 100; $i++) {
+	apcu_store("key$i", $i, 1000);
+	$ttls[] = apcu_key_info("key$i")["ttl"];
+}
+var_dump(min($ttls) >= 500, max($ttls) <= 1000, count(array_unique($ttls)) > 1);
+
+/* the option overrides apc.ttl_jitter */
+apcu_store("exact", 1, 1000, ["jitter" => 0]);
+var_dump(apcu_key_info("exact")["ttl"]);
+
+apcu_add("added", 1, 10, ["jitter" => 100]);
+var_dump(apcu_key_info("added")["ttl"] >= 1);
+
+/* entries without a ttl are left alone */
+apcu_store("forever", 1);
+var_dump(apcu_key_info("forever")["ttl"]);
+
+var_dump(apcu_store("invalid", 1, 10, ["jitter" => 101]));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECTF--
+bool(true)
+bool(true)
+bool(true)
+int(1000)
+bool(true)
+int(0)
+
+Warning: apcu_store(): apcu_store() expects the jitter option to be between 0 and 100 in %s on line %d
+bool(false)
+===DONE===
@@ -0,0 +1,70 @@
+--TEST--
+APC: apcu_touch and sliding entries extend the ttl without storing the value again
+--SKIPIF--
+<?php
+require_once(__DIR__ . '/skipif.inc');
+if (!function_exists('apcu_inc_request_time')) die('skip APC debug build required');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=1
+--FILE--
+<?php
+apcu_store("session", ["user" => 1], 10);
+apcu_store("sliding", "value", 10, ["sliding" => true]);
+apcu_store("fixed", "value", 10);
+
+apcu_inc_request_time(8);
+var_dump(apcu_touch("session", 10));
+var_dump(apcu_touch("unknown", 10));
+apcu_store_missing("absent", 10);
+var_dump(apcu_touch("absent", 100));
+var_dump(apcu_fetch("sliding"));
+
+/* past the ttl they were stored with */
+apcu_inc_request_time(8);
+var_dump(apcu_fetch("session"));
+var_dump(apcu_fetch("sliding"));
+var_dump(apcu_fetch("fixed"));
+foreach (new APCuIterator('/^(sliding|fixed)$/') as $key => $item) {
+    var_dump($key);
+}
+
+/* the wheel removes entries once they expire for good */
+apcu_inc_request_time(11);
+apcu_store("trigger", 1);
+var_dump(apcu_fetch("session"), apcu_fetch("sliding"));
+var_dump(apcu_exists("absent"), apcu_fetch("absent", $ok), $ok);
+var_dump(apcu_cache_info(true)["num_entries"]);
+
+/* a ttl of 0 keeps the entry forever */
+apcu_store("forever", 1, 1);
+var_dump(apcu_touch("forever", 0));
+apcu_inc_request_time(100);
+var_dump(apcu_fetch("forever"));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+bool(true)
+bool(false)
+bool(false)
+string(5) "value"
+array(1) {
+  ["user"]=>
+  int(1)
+}
+string(5) "value"
+bool(false)
+string(7) "sliding"
+bool(false)
+bool(false)
+bool(false)
+bool(false)
+bool(false)
+bool(false)
+int(1)
+bool(true)
+int(1)
+===DONE===
@@ -0,0 +1,44 @@
+--TEST--
+APC: slam defense rejects stores of a key set by another process within the same second
+--SKIPIF--
+<?php
+require_once(__DIR__ . '/skipif.inc');
+if (!function_exists('pcntl_fork')) die('skip pcntl required');
+if (!function_exists('apcu_inc_request_time')) die('skip APC debug build required');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=1
+apc.slam_defense=1
+--FILE--
+<?php
+var_dump(apcu_store("key", "parent"));
+
+/* the process which set the key may set it again */
+var_dump(apcu_store("key", "parent again"));
+
+$pid = pcntl_fork();
+if ($pid == 0) {
+	/* any other process is slamming the key for the rest of the second */
+	$armed = !apcu_store("key", "child");
+
+	/* the defense expires with the second */
+	apcu_inc_request_time(1);
+	$expired = apcu_store("key", "child");
+
+	exit(($armed ? 1 : 0) | ($expired ? 2 : 0));
+}
+
+pcntl_waitpid($pid, $status);
+var_dump(pcntl_wexitstatus($status));
+var_dump(apcu_fetch("key"));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+bool(true)
+bool(true)
+int(3)
+string(5) "child"
+===DONE===
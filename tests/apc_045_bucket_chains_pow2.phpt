@@ -0,0 +1,69 @@
+--TEST--
+APC: chains past the tagged entries of power of two buckets
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.pow2_slots=1
+apc.entries_hint=16
+apc.shm_size=32M
+--FILE--
+<?php
+/* about four entries per bucket, many chains run past the tagged entries */
+for ($i = 0; $i < 1000; $i++) {
+	apcu_store("key$i", $i);
+}
+
+$info = apcu_cache_info();
+var_dump($info['num_slots']);
+var_dump(max($info['slot_distribution']) > 4);
+var_dump(array_sum($info['slot_distribution']));
+
+$ok = true;
+for ($i = 0; $i < 1000; $i++) {
+	$ok = $ok && apcu_fetch("key$i") === $i && apcu_exists("key$i");
+}
+var_dump($ok);
+
+/* keys sharing buckets with stored keys must still miss */
+$ok = true;
+for ($i = 1000; $i < 3000; $i++) {
+	$ok = $ok && !apcu_exists("key$i") && apcu_fetch("key$i") === false;
+}
+var_dump($ok);
+
+/* deletes from the tagged entries and from the rest of the chains */
+for ($i = 0; $i < 1000; $i += 3) {
+	apcu_delete("key$i");
+}
+
+$ok = true;
+for ($i = 0; $i < 1000; $i++) {
+	$ok = $ok && apcu_fetch("key$i") === ($i % 3 ? $i : false);
+}
+var_dump($ok);
+
+/* entries stored again are found wherever they end up in the chain */
+for ($i = 0; $i < 1000; $i += 3) {
+	apcu_store("key$i", -$i);
+}
+
+$ok = true;
+for ($i = 0; $i < 1000; $i++) {
+	$ok = $ok && apcu_fetch("key$i") === ($i % 3 ? $i : -$i);
+}
+var_dump($ok);
+var_dump(apcu_cache_info(true)['num_entries']);
+?>
+===DONE===
+--EXPECT--
+int(256)
+bool(true)
+int(1000)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+int(1000)
+===DONE===
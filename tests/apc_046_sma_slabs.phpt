@@ -0,0 +1,70 @@
+--TEST--
+APC: small entries are served from slabs, and sma_info accounts for their free chunks
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.shm_size=16M
+--FILE--
+<?php
+function free_mem() {
+	$info = apcu_sma_info();
+	$blocks = 0;
+	foreach ($info['block_lists'] as $list) {
+		foreach ($list as $block) {
+			$blocks += $block['size'];
+		}
+	}
+	/* the bounds of the segments are not on any list */
+	return [$info['avail_mem'], $info['avail_mem'] - $blocks];
+}
+
+list($initial, $bounds) = free_mem();
+
+for ($i = 0; $i < 2000; $i++) {
+	apcu_store("small$i", $i);
+}
+
+list($avail, $diff) = free_mem();
+var_dump($avail < $initial);
+var_dump($diff == $bounds);
+
+/* the chunks are free again once the entries are reclaimed */
+for ($i = 0; $i < 2000; $i++) {
+	apcu_delete("small$i");
+}
+apcu_store("trigger", 1);
+apcu_delete("trigger");
+apcu_store("trigger", 1);
+
+list($freed, $diff) = free_mem();
+var_dump($freed > $avail);
+var_dump($diff == $bounds);
+
+/* freed chunks are used again before new slabs are carved */
+for ($i = 0; $i < 2000; $i++) {
+	apcu_store("again$i", $i);
+}
+
+list($reused, $diff) = free_mem();
+var_dump($reused > $avail - 32 * 1024);
+var_dump($diff == $bounds);
+
+$ok = true;
+for ($i = 0; $i < 2000; $i++) {
+	$ok = $ok && apcu_fetch("again$i") === $i && !apcu_exists("small$i");
+}
+var_dump($ok);
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+bool(true)
+===DONE===
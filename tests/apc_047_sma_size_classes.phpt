@@ -0,0 +1,65 @@
+--TEST--
+APC: free blocks of mixed sizes are reused and coalesce into a large block again
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.shm_size=32M
+--FILE--
+<?php
+function largest_block() {
+	$largest = 0;
+	foreach (apcu_sma_info()['block_lists'] as $list) {
+		foreach ($list as $block) {
+			$largest = max($largest, $block['size']);
+		}
+	}
+	return $largest;
+}
+
+/* sizes spread over many size classes, all too large for slabs */
+function value($i) {
+	return str_repeat(chr(65 + $i % 26), 2048 + ($i * 7919) % 63000);
+}
+
+for ($i = 0; $i < 600; $i++) {
+	apcu_store("mixed$i", value($i));
+}
+
+/* every other block goes back to the free lists, and is taken by new stores */
+for ($i = 0; $i < 600; $i += 2) {
+	apcu_delete("mixed$i");
+}
+for ($i = 600; $i < 800; $i++) {
+	apcu_store("mixed$i", value($i));
+}
+
+$ok = true;
+for ($i = 1; $i < 800; $i += ($i < 600 ? 2 : 1)) {
+	$ok = $ok && apcu_fetch("mixed$i") === value($i);
+}
+var_dump($ok);
+
+/* once everything is freed, neighbours merge again, only the slab kept for small
+ * allocations may split the segment */
+apcu_delete(new APCuIterator('/^mixed/'));
+apcu_store("trigger", 1);
+apcu_delete("trigger");
+apcu_store("trigger", 1);
+var_dump(largest_block() > 14 * 1024 * 1024);
+
+$big = str_repeat("x", 14 * 1024 * 1024);
+var_dump(apcu_store("big", $big));
+var_dump(strlen(apcu_fetch("big")));
+var_dump(apcu_cache_info(true)['expunges']);
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+bool(true)
+bool(true)
+bool(true)
+int(14680064)
+float(0)
+===DONE===
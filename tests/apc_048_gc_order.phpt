@@ -0,0 +1,51 @@
+--TEST--
+APC: removed entries wait on the gc list in the order they were removed
+--SKIPIF--
+<?php require_once(dirname(__FILE__) . '/skipif.inc'); ?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.optimistic_reads=1
+--FILE--
+<?php
+function deleted() {
+	return array_map(function ($entry) {
+		return $entry["info"];
+	}, apcu_cache_info()["deleted_list"]);
+}
+
+apcu_store("a", 1);
+apcu_store("b", [2]);
+apcu_store("c", "3");
+
+/* removed entries are appended to the list, removing never frees */
+apcu_delete("c");
+apcu_delete("a");
+apcu_delete("b");
+echo implode(",", deleted()), "\n";
+
+$info = apcu_cache_info()["deleted_list"];
+var_dump($info[0]["deletion_time"] <= $info[2]["deletion_time"]);
+
+/* nobody reads anymore, the next insert frees the whole list, oldest first */
+apcu_store("d", 5);
+var_dump(deleted());
+
+/* the entry a store replaces goes after the entries removed before */
+apcu_store("e", 6);
+apcu_store("d", 7);
+apcu_delete("e");
+echo implode(",", deleted()), "\n";
+var_dump(apcu_fetch("d"), apcu_fetch("e"));
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+c,a,b
+bool(true)
+array(0) {
+}
+d,e
+int(7)
+bool(false)
+===DONE===
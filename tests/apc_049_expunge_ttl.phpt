@@ -0,0 +1,56 @@
+--TEST--
+APC: an expunge with apc.ttl removes the stale entries, and keeps the live ones
+--SKIPIF--
+<?php
+require_once(__DIR__ . '/skipif.inc');
+if (!function_exists('apcu_inc_request_time')) die('skip APC debug build required');
+?>
+--INI--
+apc.enabled=1
+apc.enable_cli=1
+apc.use_request_time=1
+apc.ttl=10
+apc.shm_size=16M
+--FILE--
+<?php
+$value = str_repeat("x", 8192);
+
+/* entries nobody reads anymore, soft expired once apc.ttl passed */
+for ($i = 0; $i < 1400; $i++) {
+	apcu_store("junk$i", $value);
+}
+
+apcu_inc_request_time(15);
+for ($i = 0; $i < 100; $i++) {
+	apcu_store("live$i", $i);
+}
+
+/* more than fits next to the junk, the expunge must make room, few and large stores
+ * so that the inserts do not run into the junk of their own slots */
+apcu_inc_request_time(5);
+$large = str_repeat("y", 1200 * 1024);
+$ok = true;
+for ($i = 0; $i < 5; $i++) {
+	$ok = apcu_store("fill$i", $large) && $ok;
+}
+var_dump($ok);
+
+$ok = true;
+for ($i = 0; $i < 100; $i++) {
+	$ok = $ok && apcu_fetch("live$i") === $i;
+}
+var_dump($ok);
+var_dump(apcu_exists("junk0"), apcu_fetch("fill4") === $large);
+
+/* the stale entries were freed, rather than the whole cache */
+var_dump(apcu_cache_info(true)['expunges']);
+?>
+===DONE===
+<?php exit(0); ?>
+--EXPECT--
+bool(true)
+bool(true)
+bool(false)
+bool(true)
+float(0)
+===DONE===